@@ -0,0 +1,234 @@
+// Cost of each binding registered by registerMathFunctions: calls per second,
+// allocations and bytes per call, and the GC time per call to collect what the
+// calls left behind. Results go out as JSON so runs can be diffed.
+//
+// usage: bench_bind_costs [out.json]   (JSON to stdout without a path)
+//
+// Each case is one Lua statement run in a numeric for loop with the GC stopped;
+// "loop" is the empty loop to subtract. GC time is one full collection after
+// the loop minus one of the same heap without the garbage.
+
+#include "lua_alloc.h"
+#include "lua_functions.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace {
+struct Case {
+    const char* name;
+    const char* statement;
+};
+
+const char* prelude = R"lua(
+local a, b, out = vec3(1, 2, 3), vec3(4, 5, 6), vec3(0, 0, 0)
+local axis = vec3(0, 0, 1)
+local q, r = quat(0.5, axis), quat(1.0, vec3(1, 0, 0))
+local t, u = transform(a, q), transform(b, r)
+local key, distance = 1.5, 100
+local onRoad = roadSplinePositionAtKey(key)
+local keys, distances, positions = FloatArray(1000), FloatArray(1000), Vec3Array(1000)
+for i = 1, #keys do keys:set(i, (i - 1) / #keys * (roadSplineNumSegments() - 1)) end
+local rows = {}
+for i = 1, 100 do rows[i] = { i, i * 2, i * 3, i * 4 } end
+local arr = Arr2d(rows)
+arr:buildIndex(1)
+local row, col = arr:row(3), arr:col(2)
+local grid = Arr2d.grid(arr)
+local tmp = {}
+)lua";
+
+const Case cases[] = {
+    { "loop", "" },
+
+    { "vec3", "local _ = vec3(1, 2, 3)" },
+    { "vec3 __add", "local _ = a + b" },
+    { "vec3 __sub", "local _ = a - b" },
+    { "vec3 __mul number", "local _ = a * 2" },
+    { "vec3 __div", "local _ = a / b" },
+    { "vec3 __index", "local _ = a.x" },
+    { "vec3 __newindex", "a.x = 1" },
+    { "vec3 __tostring", "local _ = tostring(a)" },
+    { "dot", "local _ = dot(a, b)" },
+    { "cross", "local _ = cross(a, b)" },
+    { "cross out", "local _ = cross(a, b, out)" },
+    { "normalize vec3", "local _ = normalize(a)" },
+
+    { "quat angle axis", "local _ = quat(0.5, axis)" },
+    { "quat xyzw", "local _ = quat(0, 0, 0, 1)" },
+    { "quat __mul quat", "local _ = q * r" },
+    { "quat __mul vec3", "local _ = q * a" },
+    { "quat __tostring", "local _ = tostring(q)" },
+    { "inverse", "local _ = inverse(q)" },
+    { "normalize quat", "local _ = normalize(q)" },
+
+    { "transform", "local _ = transform(a, q)" },
+    { "transform __mul vec3", "local _ = t * a" },
+    { "transformPoint out", "local _ = t:transformPoint(a, out)" },
+    { "inverseTransformPoint", "local _ = t:inverseTransformPoint(a)" },
+    { "compose", "local _ = t:compose(u)" },
+    { "transform lerp", "local _ = t:lerp(u, 0.5)" },
+    { "transform slerp", "local _ = t:slerp(u, 0.5)" },
+
+    { "roadSplineLength", "local _ = roadSplineLength()" },
+    { "roadSplineNumSegments", "local _ = roadSplineNumSegments()" },
+    { "roadSplineDistanceToKey", "local _ = roadSplineDistanceToKey(distance)" },
+    { "roadSplineKeyToDistance", "local _ = roadSplineKeyToDistance(key)" },
+    { "roadSplinePositionAtKey", "local _ = roadSplinePositionAtKey(key)" },
+    { "roadSplinePositionAndRotationAtKey", "local _ = roadSplinePositionAndRotationAtKey(key)" },
+    { "roadSplineKeyClosestToPosition", "local _ = roadSplineKeyClosestToPosition(onRoad)" },
+    { "roadSplineKeyToDistance x1000", "roadSplineKeyToDistance(keys, distances)" },
+    { "roadSplineDistanceToKey x1000", "roadSplineDistanceToKey(distances, keys)" },
+    { "roadSplinePositionAtKey x1000", "roadSplinePositionAtKey(keys, positions)" },
+
+    { "Arr2d get", "local _ = arr:get(2, 3)" },
+    { "Arr2d set", "arr:set(2, 3, 1.5)" },
+    { "Arr2d size", "local _ = arr:size()" },
+    { "Arr2d getRow", "arr:getRow(3, tmp)" },
+    { "Arr2d row", "local _ = arr:row(3)" },
+    { "Arr2d col", "local _ = arr:col(2)" },
+    { "Arr2d binarySearchByCol", "arr:binarySearchByCol(1, 50.5, tmp)" },
+    { "Arr2d buildIndex cached", "arr:buildIndex(1)" },
+    { "Arr2d findRange", "arr:findRange(1, 10, 20, tmp)" },
+    { "Arr2d nearest", "local _ = arr:nearest(1, 42.3)" },
+    { "Arr2dView get", "local _ = row:get(3)" },
+    { "Arr2dView set", "col:set(5, 1)" },
+    { "Arr2dView __len", "local _ = #row" },
+    { "Arr2dView toTable", "col:toTable(tmp)" },
+    { "Arr2dGrid sample", "local _ = grid:sample(2.5, 50.5)" },
+    { "Arr2dGrid size", "local _ = grid:size()" },
+};
+
+constexpr double targetSeconds = 0.1;
+constexpr int minCalls = 10000;
+constexpr int maxCalls = 2000000; // bounds the heap while the GC is stopped
+constexpr int passes = 3;
+
+struct Result {
+    int calls = 0;
+    double nsPerCall = 1e30;
+    double allocsPerCall = 0.0;
+    double bytesPerCall = 0.0;
+    double gcNsPerCall = 1e30;
+};
+
+double now()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// runs the case function at the top of the stack n times, false on a Lua error
+bool call(lua_State* L, int n)
+{
+    lua_pushvalue(L, -1);
+    lua_pushinteger(L, n);
+    if (lua_pcall(L, 1, 0, 0) == LUA_OK)
+        return true;
+    fprintf(stderr, "Lua error: %s\n", lua_tostring(L, -1));
+    lua_pop(L, 1);
+    return false;
+}
+
+double collectSeconds(lua_State* L)
+{
+    const double t0 = now();
+    lua_gc(L, LUA_GCCOLLECT);
+    return now() - t0;
+}
+
+bool measure(lua_State* L, const LuaAllocator& allocator, const Case& c, Result& result)
+{
+    const std::string chunk = std::string(prelude) + "return function(n) for _ = 1, n do " + c.statement + " end end";
+    if (luaL_loadbuffer(L, chunk.data(), chunk.size(), c.name) != LUA_OK || lua_pcall(L, 0, 1, 0) != LUA_OK) {
+        fprintf(stderr, "%s: %s\n", c.name, lua_tostring(L, -1));
+        lua_pop(L, 1);
+        return false;
+    }
+
+    // calibrate to about targetSeconds per pass
+    const double t0 = now();
+    if (!call(L, minCalls))
+        return false;
+    const double seconds = std::max(now() - t0, 1e-9);
+    result.calls = std::clamp(int(minCalls * targetSeconds / seconds), minCalls, maxCalls);
+
+    for (int pass = 0; pass < passes; ++pass) {
+        lua_gc(L, LUA_GCCOLLECT);
+        const double baseGc = collectSeconds(L);
+        lua_gc(L, LUA_GCSTOP);
+
+        const LuaAllocator::Stats before = allocator.getStats();
+        const double start = now();
+        const bool ok = call(L, result.calls);
+        const double elapsed = now() - start;
+        const LuaAllocator::Stats after = allocator.getStats();
+
+        lua_gc(L, LUA_GCRESTART);
+        const double gc = collectSeconds(L);
+        if (!ok)
+            return false;
+
+        result.nsPerCall = std::min(result.nsPerCall, elapsed * 1e9 / result.calls);
+        result.gcNsPerCall = std::min(result.gcNsPerCall, std::max(gc - baseGc, 0.0) * 1e9 / result.calls);
+        result.allocsPerCall = double(after.allocations - before.allocations) / result.calls;
+        result.bytesPerCall = (double(after.bytesLive) - double(before.bytesLive)) / result.calls;
+    }
+
+    lua_pop(L, 1);
+    return true;
+}
+
+void writeJson(FILE* file, const std::vector<Result>& results)
+{
+    fprintf(file, "{\n  \"lua\": \"%s\",\n  \"bindings\": [\n", LUA_RELEASE);
+    for (size_t i = 0; i < results.size(); ++i) {
+        const Result& r = results[i];
+        fprintf(file,
+            "    { \"name\": \"%s\", \"calls\": %d, \"callsPerSec\": %.0f, \"nsPerCall\": %.2f, "
+            "\"allocsPerCall\": %.3f, \"bytesPerCall\": %.1f, \"gcNsPerCall\": %.2f }%s\n",
+            cases[i].name, r.calls, 1e9 / r.nsPerCall, r.nsPerCall, r.allocsPerCall, r.bytesPerCall,
+            r.gcNsPerCall, i + 1 < results.size() ? "," : "");
+    }
+    fprintf(file, "  ]\n}\n");
+}
+} // namespace
+
+int main(int argc, char** argv)
+{
+    LuaAllocator allocator;
+    lua_State* L = allocator.newState();
+    luaL_openlibs(L);
+    registerMathFunctions(L);
+
+    std::vector<Result> results;
+    int result = 0;
+    for (const Case& c : cases) {
+        Result r;
+        if (!measure(L, allocator, c, r)) {
+            result = 1;
+            break;
+        }
+        results.push_back(r);
+        if (argc > 1)
+            printf("%-36s %8.1f ns %6.2f allocs %8.1f B %8.1f ns GC\n", c.name, r.nsPerCall, r.allocsPerCall,
+                r.bytesPerCall, r.gcNsPerCall);
+    }
+
+    if (result == 0) {
+        FILE* file = argc > 1 ? fopen(argv[1], "w") : stdout;
+        if (file) {
+            writeJson(file, results);
+            if (file != stdout)
+                fclose(file);
+        } else {
+            fprintf(stderr, "cannot write %s\n", argv[1]);
+            result = 1;
+        }
+    }
+
+    lua_close(L);
+    return result;
+}
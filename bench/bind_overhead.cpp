@@ -0,0 +1,84 @@
+// Call overhead of generated bindings (bind/bindMethod/overloads) against
+// the hand-written lua_CFunction equivalents they replaced.
+
+#include "lua_functions.h"
+
+namespace {
+int handDot(lua_State* L)
+{
+    LUA_GET_INPUT(Vec3, a, 1);
+    LUA_GET_INPUT(Vec3, b, 2);
+    lua_pushnumber(L, a->x * b->x + a->y * b->y + a->z * b->z);
+    return 1;
+}
+
+int handCross(lua_State* L)
+{
+    LUA_GET_INPUT(Vec3, a, 1);
+    LUA_GET_INPUT(Vec3, b, 2);
+    LUA_GET_OUTPUT(Vec3);
+    *outptr = glm::cross(*a, *b);
+    return 1;
+}
+
+int handKeyToDistance(lua_State* L)
+{
+    if (!lua_isnumber(L, 1) && isBatchArg(L, 1))
+        return roadSplineKeyToDistanceBatch(L);
+
+    LUA_GET_FLOAT(key, 1);
+    lua_pushnumber(L, spline.KeyToDistance(key));
+    return 1;
+}
+
+int handLength(lua_State* L)
+{
+    lua_pushnumber(L, spline.GetLength());
+    return 1;
+}
+
+const char* benchScript = R"lua(
+local N = 2000000
+local a, b = vec3(1, 2, 3), vec3(4, 5, 6)
+
+local function run(name, hand, generated, ...)
+    local best = {}
+    for pass = 1, 3 do
+        for i, f in ipairs({ hand, generated }) do
+            local t0 = os.clock()
+            for _ = 1, N do f(...) end
+            local ns = (os.clock() - t0) * 1e9 / N
+            best[i] = math.min(best[i] or math.huge, ns)
+        end
+    end
+    print(string.format("%-28s %8.1f %8.1f ns/call", name, best[1], best[2]))
+end
+
+print(string.format("%-28s %8s %8s", "", "hand", "bind"))
+run("dot(vec3, vec3)", handDot, dot, a, b)
+run("cross(vec3, vec3)", handCross, cross, a, b)
+run("roadSplineKeyToDistance", handKeyToDistance, roadSplineKeyToDistance, 1.5)
+run("roadSplineLength", handLength, roadSplineLength)
+)lua";
+} // namespace
+
+int main()
+{
+    lua_State* L = luaL_newstate();
+    luaL_openlibs(L);
+    registerMathFunctions(L);
+
+    pushMathFunction(L, handDot), lua_setglobal(L, "handDot");
+    pushMathFunction(L, handCross), lua_setglobal(L, "handCross");
+    pushMathFunction(L, handKeyToDistance), lua_setglobal(L, "handKeyToDistance");
+    pushMathFunction(L, handLength), lua_setglobal(L, "handLength");
+
+    int result = 0;
+    if (luaL_dostring(L, benchScript) != LUA_OK) {
+        printf("Lua error: %s\n", lua_tostring(L, -1));
+        result = 1;
+    }
+
+    lua_close(L);
+    return result;
+}
@@ -0,0 +1,155 @@
+// Decoding a 10k-entry tuning config: the LuaGlobal/LuaField/LuaString/LuaNumber
+// chain per value against one luaDecode pass over the schema.
+
+#include "lua_functions.h"
+
+#include <chrono>
+
+namespace {
+struct AiTuning {
+    double aggression = 0.0;
+    int lookahead = 0;
+};
+
+struct CarTuning {
+    std::string name;
+    double mass = 0.0;
+    double power = 0.0;
+    std::vector<double> gears;
+    Vec3 spawn { 0, 0, 0 };
+    AiTuning ai;
+};
+
+struct Tuning {
+    std::vector<CarTuning> cars;
+};
+
+template <>
+struct LuaSchema<AiTuning> {
+    static constexpr auto fields = std::make_tuple(
+        luaField("aggression", &AiTuning::aggression),
+        luaField("lookahead", &AiTuning::lookahead));
+};
+
+template <>
+struct LuaSchema<CarTuning> {
+    static constexpr auto fields = std::make_tuple(
+        luaField("name", &CarTuning::name),
+        luaField("mass", &CarTuning::mass),
+        luaField("power", &CarTuning::power),
+        luaField("gears", &CarTuning::gears),
+        luaField("spawn", &CarTuning::spawn),
+        luaField("ai", &CarTuning::ai));
+};
+
+template <>
+struct LuaSchema<Tuning> {
+    static constexpr auto fields = std::make_tuple(luaField("cars", &Tuning::cars));
+};
+
+const int numEntries = 10000;
+
+const char* configScript = R"lua(
+tuning = { cars = {} }
+for i = 1, 10000 do
+    tuning.cars[i] = {
+        name = "car" .. i,
+        mass = 1000 + i,
+        power = 150 + i % 300,
+        gears = { 3.2, 2.1, 1.5, 1.1, 0.9 },
+        spawn = vec3(i, 0, 0),
+        ai = { aggression = (i % 10) / 10, lookahead = 20 + i % 5 },
+    }
+end
+)lua";
+
+// every value from the global down, as the wrappers are used today
+void decodeChained(lua_State* L, Tuning& tuning)
+{
+    tuning.cars.resize(numEntries);
+    for (int i = 0; i < numEntries; ++i) {
+        CarTuning& car = tuning.cars[i];
+        auto entry = [&](auto&& read) {
+            if (auto g = LuaGlobal(L, "tuning"))
+                if (auto cars = LuaField(L, "cars")) {
+                    lua_rawgeti(L, -1, i + 1);
+                    read();
+                    lua_pop(L, 1);
+                }
+        };
+        entry([&] { if (auto f = LuaField(L, "name")) LuaString(L, car.name); });
+        entry([&] { if (auto f = LuaField(L, "mass")) LuaNumber(L, car.mass); });
+        entry([&] { if (auto f = LuaField(L, "power")) LuaNumber(L, car.power); });
+        entry([&] {
+            if (auto f = LuaField(L, "gears")) {
+                car.gears.resize(lua_rawlen(L, -1));
+                for (size_t g = 0; g < car.gears.size(); ++g) {
+                    lua_rawgeti(L, -1, (lua_Integer)g + 1);
+                    LuaNumber(L, car.gears[g]);
+                    lua_pop(L, 1);
+                }
+            }
+        });
+        entry([&] { if (auto f = LuaField(L, "spawn")) LuaTraits<Vec3>::get(L, -1, car.spawn); });
+        entry([&] {
+            if (auto ai = LuaField(L, "ai")) {
+                if (auto f = LuaField(L, "aggression"))
+                    LuaNumber(L, car.ai.aggression);
+                double lookahead = 0;
+                if (auto f = LuaField(L, "lookahead"))
+                    LuaNumber(L, lookahead);
+                car.ai.lookahead = (int)lookahead;
+            }
+        });
+    }
+}
+
+void decodeSchema(lua_State* L, Tuning& tuning)
+{
+    std::string error;
+    lua_getglobal(L, "tuning");
+    if (!luaDecode(L, -1, tuning, &error))
+        printf("decode error: %s\n", error.c_str());
+    lua_pop(L, 1);
+}
+
+template <typename F>
+double bestMs(F&& f)
+{
+    double best = 1e30;
+    for (int pass = 0; pass < 5; ++pass) {
+        const auto t0 = std::chrono::steady_clock::now();
+        f();
+        best = std::min(best, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count());
+    }
+    return best;
+}
+} // namespace
+
+int main()
+{
+    lua_State* L = luaL_newstate();
+    luaL_openlibs(L);
+    registerMathFunctions(L);
+
+    int result = 0;
+    if (luaL_dostring(L, configScript) != LUA_OK) {
+        printf("Lua error: %s\n", lua_tostring(L, -1));
+        result = 1;
+    } else {
+        Tuning chained, schema;
+        const double chainedMs = bestMs([&] { decodeChained(L, chained); });
+        const double schemaMs = bestMs([&] { decodeSchema(L, schema); });
+
+        const CarTuning& a = chained.cars.back();
+        const CarTuning& b = schema.cars.back();
+        const bool same = a.name == b.name && a.mass == b.mass && a.gears == b.gears && a.spawn == b.spawn
+            && a.ai.lookahead == b.ai.lookahead;
+        printf("%d entries: chained %.2f ms, schema %.2f ms (%.1fx)%s\n", numEntries, chainedMs, schemaMs,
+            chainedMs / schemaMs, same ? "" : ", RESULTS DIFFER");
+        result = same ? 0 : 1;
+    }
+
+    lua_close(L);
+    return result;
+}
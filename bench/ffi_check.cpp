@@ -0,0 +1,128 @@
+// Runs ffi_check.lua on the Lua 5.4 bindings in process and under LuaJIT with
+// ffi_math.lua, then compares the printed lines. Numbers may differ by float
+// rounding (relative 1e-4, absolute below 1); all other text must match.
+//
+// usage: ffi_check [luajit]   (the LuaJIT executable, "luajit" by default)
+
+#include "lua_functions.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+namespace {
+const char scriptPath[] = PROJECT_DIR "/ffi_check.lua";
+
+// print(...) into the std::string upvalue, as the LuaJIT side writes stdout
+int l_print(lua_State* L)
+{
+    auto* output = (std::string*)lua_touserdata(L, lua_upvalueindex(1));
+    const int n = lua_gettop(L);
+    for (int i = 1; i <= n; ++i) {
+        size_t length;
+        const char* s = luaL_tolstring(L, i, &length);
+        if (i > 1)
+            *output += '\t';
+        output->append(s, length);
+        lua_pop(L, 1);
+    }
+    *output += '\n';
+    return 0;
+}
+
+bool runLua54(std::string& output)
+{
+    lua_State* L = luaL_newstate();
+    luaL_openlibs(L);
+    registerMathFunctions(L);
+    lua_pushlightuserdata(L, &output);
+    lua_pushcclosure(L, l_print, 1);
+    lua_setglobal(L, "print");
+
+    const bool ok = luaL_dofile(L, scriptPath) == LUA_OK;
+    if (!ok)
+        fprintf(stderr, "Lua 5.4: %s\n", lua_tostring(L, -1));
+    lua_close(L);
+    return ok;
+}
+
+bool runLuaJit(const char* luajit, std::string& output)
+{
+    const std::string command = std::string("LUA_MATH_FFI='") + LUA_MATH_FFI_LIB + "' LUA_PATH='" PROJECT_DIR "/?.lua;;' "
+        + luajit + " -l ffi_math '" + scriptPath + "'";
+    FILE* pipe = popen(command.c_str(), "r");
+    if (!pipe) {
+        fprintf(stderr, "cannot run %s\n", command.c_str());
+        return false;
+    }
+
+    char buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), pipe)) > 0)
+        output.append(buf, n);
+    return pclose(pipe) == 0;
+}
+
+std::vector<std::string> splitLines(const std::string& s)
+{
+    std::vector<std::string> lines;
+    size_t begin = 0;
+    for (size_t end; (end = s.find('\n', begin)) != std::string::npos; begin = end + 1)
+        lines.push_back(s.substr(begin, end - begin));
+    if (begin < s.size())
+        lines.push_back(s.substr(begin));
+    return lines;
+}
+
+bool isNumberStart(const char* p)
+{
+    if (*p == '-' || *p == '+')
+        ++p;
+    if (*p == '.')
+        ++p;
+    return *p >= '0' && *p <= '9';
+}
+
+// "1" and "1.0" are the same number; NaN and inf compare as text
+bool sameLine(const std::string& a, const std::string& b)
+{
+    const char *p = a.c_str(), *q = b.c_str();
+    while (*p && *q) {
+        if (isNumberStart(p) && isNumberStart(q)) {
+            char *pEnd, *qEnd;
+            const double x = strtod(p, &pEnd), y = strtod(q, &qEnd);
+            if (std::abs(x - y) > 1e-4 * std::max({ 1.0, std::abs(x), std::abs(y) }))
+                return false;
+            p = pEnd, q = qEnd;
+        } else if (*p++ != *q++) {
+            return false;
+        }
+    }
+    return *p == *q;
+}
+} // namespace
+
+int main(int argc, char** argv)
+{
+    std::string lua54, luaJit;
+    if (!runLua54(lua54) || !runLuaJit(argc > 1 ? argv[1] : "luajit", luaJit)) {
+        fprintf(stderr, "%s", luaJit.c_str());
+        return 1;
+    }
+
+    const std::vector<std::string> a = splitLines(lua54), b = splitLines(luaJit);
+    int numDiffs = 0;
+    for (size_t i = 0; i < std::max(a.size(), b.size()); ++i) {
+        const std::string& x = i < a.size() ? a[i] : std::string();
+        const std::string& y = i < b.size() ? b[i] : std::string();
+        if (!sameLine(x, y)) {
+            printf("line %d\n  5.4:    %s\n  LuaJIT: %s\n", int(i + 1), x.c_str(), y.c_str());
+            ++numDiffs;
+        }
+    }
+    printf("%d lines, %d differ\n", int(std::max(a.size(), b.size())), numDiffs);
+    return numDiffs ? 1 : 0;
+}
@@ -0,0 +1,15 @@
+-- Bot logic for LuaWorkerPool: every worker thread loads this into its own
+-- lua_State. updateBot may only depend on its arguments and on the shared
+-- read-only data behind the bindings, never on globals it writes itself.
+-- roadData is the road sampled by distance, shared by all workers without
+-- copies: blobFloats(roadData, "keys"), blobVec3s(roadData, "positions").
+
+local maxSpeed = 3000
+local acceleration = 500
+
+function updateBot(index, key, speed, dt)
+    local length = roadSplineLength()
+    local distance = (roadSplineKeyToDistance(key) + speed * dt) % length
+    speed = math.min(speed + acceleration * dt, maxSpeed)
+    return roadSplineDistanceToKey(distance), speed
+end
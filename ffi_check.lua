@@ -0,0 +1,78 @@
+-- The math API shared by both backends, one printed line per check. ffi_check
+-- (BUILD_LUAJIT_FFI) runs it on the Lua 5.4 bindings and under LuaJIT with
+-- ffi_math.lua, then compares the lines with a float tolerance. Only pcall
+-- results are printed for errors, the messages differ between backends.
+
+if jit and not vec3 then
+    require("ffi_math")
+end
+
+local function check(name, ...)
+    local values = { ... }
+    for i = 1, select("#", ...) do
+        values[i] = tostring(values[i])
+    end
+    print(name, table.concat(values, " "))
+end
+
+-- vec3
+local a, b = vec3(1, 2, 3), vec3(4, 5, 6)
+check("vec3 add sub", a + b, a - b, a - 1)
+check("vec3 mul div", a * 2, 2 * a, a / 2, a / b)
+check("vec3 dot cross", dot(a, b), cross(a, b), cross(vec3(1, 0, 0), vec3(0, 1, 0)))
+check("vec3 normalize", normalize(vec3(3, 0, 4)))
+local v = vec3(1, 2, 3)
+v.x = 10
+check("vec3 fields", v.x, v.y, v.z, v.w, v)
+local out = vec3(0, 0, 0)
+check("vec3 cross out", rawequal(cross(a, b, out), out), out)
+
+-- quat, w first as in glm
+local q = quat(1.0, vec3(0, 0, 1))
+check("quat angle axis", q, quat(0.5, vec3(1, 1, 0)))
+check("quat wxyz", quat(1, 2, 3, 4), normalize(quat(1, 2, 3, 4)))
+check("quat mul", quat(1, 2, 3, 4) * quat(0.3, vec3(1, 1, 0)), q * a)
+check("quat inverse", inverse(quat(1, 2, 3, 4)), inverse(q) * (q * a))
+
+-- transform
+local t = transform(vec3(1, 2, 3), q)
+local u = transform(vec3(-1, 0, 0), quat(0.5, vec3(1, 0, 0)))
+local p = vec3(4, 5, 6)
+check("transform point", t:transformPoint(p), t * p, q * p + vec3(1, 2, 3))
+check("transform inverse point", t:inverseTransformPoint(t:transformPoint(p)))
+check("transform compose", (t * u):transformPoint(p), t:compose(u):transformPoint(p), t:transformPoint(u:transformPoint(p)))
+check("transform inverse", t:compose(t:inverse()), t:inverse():transformPoint(p))
+check("transform lerp slerp", t:lerp(u, 0.5), t:slerp(u, 0.5))
+check("transform fields", t.pos, t.rot, t)
+check("transform default", transform())
+local points = t:transformPoints({ p, a })
+check("transform points", #points, points[1], points[2], t:inverseTransformPoints(points)[2])
+
+-- road spline
+check("spline length", roadSplineLength(), roadSplineNumSegments())
+check("spline distance key", roadSplineDistanceToKey(100), roadSplineKeyToDistance(1.5))
+check("spline position", roadSplinePositionAtKey(1.5), roadSplinePositionAtKey(0), roadSplinePositionAtKey(100))
+check("spline frame", roadSplinePositionAndRotationAtKey(1.5))
+check("spline frame near", roadSplinePositionAndRotationAtKey(1.5001))
+local pos, rot = vec3(0, 0, 0), quat(0, 0, 0, 1)
+roadSplinePositionAndRotationAtKey(2.25, pos, rot)
+check("spline frame out", pos, rot)
+check("spline closest", roadSplineKeyClosestToPosition(roadSplinePositionAtKey(2.25)))
+local keys = roadSplineDistanceToKey({ 10, 2000, 30000 })
+check("spline batch keys", #keys, keys[1], keys[2], keys[3])
+local distances = roadSplineKeyToDistance(keys)
+check("spline batch distances", distances[1], distances[2], distances[3])
+check("spline batch positions", roadSplinePositionAtKey({ 1, 2 })[2])
+check("spline batch closest", roadSplineKeyClosestToPosition({ roadSplinePositionAtKey(3.5) })[1])
+
+-- errors
+check("errors", pcall(function() return a + "x" end), pcall(function() return quat(1, 2, 3, 4) * 5 end),
+    (pcall(normalize, 5)))
+
+-- bots.lua
+dofile((debug.getinfo(1, "S").source:match("^@(.*[/\\])") or "./") .. "bots.lua")
+local key, speed = 1.5, 100
+for _ = 1, 100 do
+    key, speed = updateBot(1, key, speed, 1 / 60)
+end
+check("updateBot", key, speed)
@@ -0,0 +1,414 @@
+-- LuaJIT FFI backend of the math bindings: the globals registerMathFunctions
+-- sets for vec3, quat, transform and the road spline, with Vec3/Quat/Transform
+-- as ffi.cdef structs the JIT compiles inline instead of boxed userdata.
+--
+--   luajit -l ffi_math ffi_check.lua
+--
+-- The spline calls go to the C entry points of src/lua_ffi.h: through ffi.C
+-- when the host executable links and exports them, otherwise from the
+-- lua_math_ffi library (BUILD_LUAJIT_FFI), or the path in $LUA_MATH_FFI.
+-- ffi_check.lua covers the shared API and bots.lua; the ffi_check target runs
+-- it on both backends and compares the output.
+--
+-- Batch forms take and fill tables. FloatArray, Vec3Array, Arr2d, kernel, the
+-- blob* views and the host's scheduler (spawnBot, wait, signal) exist only on
+-- the Lua 5.4 backend, so test.lua (Arr2d) and editor scripts using them are
+-- 5.4-only.
+
+local ffi = require("ffi")
+
+ffi.cdef [[
+typedef struct { float x, y, z; } Vec3;
+typedef struct { float x, y, z, w; } Quat;
+typedef struct { Vec3 p; Quat r; } Transform;
+
+float ffiRoadSplineLength();
+int ffiRoadSplineNumSegments();
+float ffiRoadSplineDistanceToKey(float distance);
+float ffiRoadSplineKeyToDistance(float key);
+void ffiRoadSplinePositionAtKey(float key, Vec3* out);
+void ffiRoadSplinePositionAndRotationAtKey(float key, Vec3* pos, Quat* rot);
+float ffiRoadSplineKeyClosestToPosition(const Vec3* pos);
+]]
+
+local C
+do
+    local linked, symbol = pcall(function() return ffi.C.ffiRoadSplineLength end)
+    C = linked and symbol and ffi.C or ffi.load(os.getenv("LUA_MATH_FFI") or "lua_math_ffi")
+end
+
+local sqrt, sin, cos, acos, type, error, istype = math.sqrt, math.sin, math.cos, math.acos, type, error, ffi.istype
+local Vec3, Quat, Transform -- ctypes
+
+-- numbers as the 5.4 bindings print them: "%.14g", integral values get ".0"
+local function num(x)
+    local s = string.format("%.14g", x)
+    if s:match("^-?%d+$") then
+        s = s .. ".0"
+    end
+    return s
+end
+
+local function isVec3(v) return istype(Vec3, v) end
+local function isQuat(q) return istype(Quat, q) end
+
+-- the optional out argument of the 5.4 bindings: written when given, else a new value
+local function setVec3(out, x, y, z)
+    if isVec3(out) then
+        out.x, out.y, out.z = x, y, z
+        return out
+    end
+    return Vec3(x, y, z)
+end
+
+local function setQuat(out, x, y, z, w)
+    if isQuat(out) then
+        out.x, out.y, out.z, out.w = x, y, z, w
+        return out
+    end
+    return Quat(x, y, z, w)
+end
+
+local function rotate(q, vx, vy, vz) -- v' = v + w * t + cross(q, t), t = 2 * cross(q, v)
+    local qx, qy, qz, qw = q.x, q.y, q.z, q.w
+    local tx, ty, tz = 2 * (qy * vz - qz * vy), 2 * (qz * vx - qx * vz), 2 * (qx * vy - qy * vx)
+    return vx + qw * tx + (qy * tz - qz * ty), vy + qw * ty + (qz * tx - qx * tz), vz + qw * tz + (qx * ty - qy * tx)
+end
+
+local function mulQuat(a, b)
+    return a.w * b.x + a.x * b.w + a.y * b.z - a.z * b.y,
+        a.w * b.y + a.y * b.w + a.z * b.x - a.x * b.z,
+        a.w * b.z + a.z * b.w + a.x * b.y - a.y * b.x,
+        a.w * b.w - a.x * b.x - a.y * b.y - a.z * b.z
+end
+
+local function normalized4(x, y, z, w)
+    local len = sqrt(x * x + y * y + z * z + w * w)
+    if len <= 0 then
+        return 0, 0, 0, 1
+    end
+    return x / len, y / len, z / len, w / len
+end
+
+local function checkNumber(v, i)
+    local n = tonumber(v)
+    if not n then
+        error(string.format("bad argument #%d (number expected, got %s)", i, type(v)), 3)
+    end
+    return n
+end
+
+local function checkVec3(v, i)
+    if not isVec3(v) then
+        error(string.format("bad argument #%d (Vec3Meta expected, got %s)", i, type(v)), 3)
+    end
+    return v
+end
+
+local function checkQuat(q, i)
+    if not isQuat(q) then
+        error(string.format("bad argument #%d (QuatMeta expected, got %s)", i, type(q)), 3)
+    end
+    return q
+end
+
+local function checkTransform(t, i)
+    if not istype(Transform, t) then
+        error(string.format("bad argument #%d (TransformMeta expected, got %s)", i, type(t)), 3)
+    end
+    return t
+end
+
+--
+-- VEC3
+--
+
+local function binaryVec3(op)
+    return function(a, b)
+        if isVec3(a) and isVec3(b) then
+            return Vec3(op(a.x, b.x), op(a.y, b.y), op(a.z, b.z))
+        elseif isVec3(a) and type(b) == "number" then
+            return Vec3(op(a.x, b), op(a.y, b), op(a.z, b))
+        elseif type(a) == "number" and isVec3(b) then
+            return Vec3(op(a, b.x), op(a, b.y), op(a, b.z))
+        end
+        error("Invalid operands for vec3 operations", 2)
+    end
+end
+
+Vec3 = ffi.metatype("Vec3", {
+    __add = binaryVec3(function(a, b) return a + b end),
+    __sub = binaryVec3(function(a, b) return a - b end),
+    __mul = binaryVec3(function(a, b) return a * b end),
+    __div = binaryVec3(function(a, b) return a / b end),
+    __tostring = function(v) return "vec3(" .. num(v.x) .. ", " .. num(v.y) .. ", " .. num(v.z) .. ")" end,
+    __index = function() return nil end, -- x, y, z are fields
+    __newindex = function() end,
+})
+
+function vec3(x, y, z)
+    return Vec3(checkNumber(x, 1), checkNumber(y, 2), checkNumber(z, 3))
+end
+
+function dot(a, b)
+    checkVec3(a, 1)
+    checkVec3(b, 2)
+    return a.x * b.x + a.y * b.y + a.z * b.z
+end
+
+function cross(a, b, out)
+    checkVec3(a, 1)
+    checkVec3(b, 2)
+    return setVec3(out, a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x)
+end
+
+--
+-- QUAT
+--
+
+Quat = ffi.metatype("Quat", {
+    __mul = function(q, b)
+        if isQuat(q) then
+            if isVec3(b) then -- vec = quat * vec
+                return Vec3(rotate(q, b.x, b.y, b.z))
+            elseif isQuat(b) then -- quat = quat * quat
+                return Quat(normalized4(mulQuat(q, b)))
+            end
+        end
+        error("Correct operands: (quat = quat * quat) or (vec = quat * vec)", 2)
+    end,
+    __tostring = function(q)
+        return "quat(" .. num(q.x) .. ", " .. num(q.y) .. ", " .. num(q.z) .. ", " .. num(q.w) .. ")"
+    end,
+    __index = function() return nil end,
+    __newindex = function() end,
+})
+
+-- quat(angle, axis) or quat(w, x, y, z), normalized; the 5.4 binding hands
+-- its four numbers to glm's constructor, which takes w first
+function quat(a, b, c, d)
+    if type(a) == "number" and isVec3(b) then
+        local len = sqrt(b.x * b.x + b.y * b.y + b.z * b.z)
+        local s = sin(a * 0.5) / len
+        return Quat(b.x * s, b.y * s, b.z * s, cos(a * 0.5))
+    end
+    local w, x, y, z = checkNumber(a, 1), checkNumber(b, 2), checkNumber(c, 3), checkNumber(d, 4)
+    return Quat(normalized4(x, y, z, w))
+end
+
+function inverse(q, out)
+    checkQuat(q, 1)
+    local len2 = q.x * q.x + q.y * q.y + q.z * q.z + q.w * q.w
+    return setQuat(out, -q.x / len2, -q.y / len2, -q.z / len2, q.w / len2)
+end
+
+function normalize(v)
+    if isVec3(v) then
+        local len = sqrt(v.x * v.x + v.y * v.y + v.z * v.z)
+        return Vec3(v.x / len, v.y / len, v.z / len)
+    elseif isQuat(v) then
+        return Quat(normalized4(v.x, v.y, v.z, v.w))
+    end
+    error("Correct operands for normalize: quat, vec3", 2)
+end
+
+--
+-- TRANSFORM
+--
+
+local function setTransform(out, px, py, pz, rx, ry, rz, rw)
+    if not istype(Transform, out) then
+        out = Transform()
+    end
+    out.p.x, out.p.y, out.p.z = px, py, pz
+    out.r.x, out.r.y, out.r.z, out.r.w = rx, ry, rz, rw
+    return out
+end
+
+local function transformPoint(t, p, out)
+    checkTransform(t, 1)
+    checkVec3(p, 2)
+    local x, y, z = rotate(t.r, p.x, p.y, p.z)
+    return setVec3(out, x + t.p.x, y + t.p.y, z + t.p.z)
+end
+
+local function inverseTransformPoint(t, p, out)
+    checkTransform(t, 1)
+    checkVec3(p, 2)
+    local r = t.r
+    return setVec3(out, rotate(Quat(-r.x, -r.y, -r.z, r.w), p.x - t.p.x, p.y - t.p.y, p.z - t.p.z))
+end
+
+-- b, then a
+local function compose(a, b, out)
+    checkTransform(a, 1)
+    checkTransform(b, 2)
+    local x, y, z = rotate(a.r, b.p.x, b.p.y, b.p.z)
+    local rx, ry, rz, rw = mulQuat(a.r, b.r)
+    return setTransform(out, x + a.p.x, y + a.p.y, z + a.p.z, rx, ry, rz, rw)
+end
+
+-- transformPoints({vec3, ...} [, out]) -> out, vec3s already in out are reused
+local function transformPoints(t, points, out, inverse)
+    checkTransform(t, 1)
+    out = out or {}
+    for i = 1, #points do
+        local p = points[i]
+        out[i] = (inverse and inverseTransformPoint or transformPoint)(t, p, isVec3(out[i]) and out[i] or nil)
+    end
+    return out
+end
+
+local transformMethods = {
+    transformPoint = transformPoint,
+    inverseTransformPoint = inverseTransformPoint,
+    transformPoints = function(t, points, out) return transformPoints(t, points, out, false) end,
+    inverseTransformPoints = function(t, points, out) return transformPoints(t, points, out, true) end,
+    compose = compose,
+    inverse = function(t, out)
+        checkTransform(t, 1)
+        local r = t.r
+        local x, y, z = rotate(Quat(-r.x, -r.y, -r.z, r.w), -t.p.x, -t.p.y, -t.p.z)
+        return setTransform(out, x, y, z, -r.x, -r.y, -r.z, r.w)
+    end,
+    -- positions mix linearly, rotations take the short way (nlerp)
+    lerp = function(a, b, s, out)
+        checkTransform(a, 1)
+        checkTransform(b, 2)
+        s = checkNumber(s, 3)
+        local ar, br = a.r, b.r
+        local sign = (ar.x * br.x + ar.y * br.y + ar.z * br.z + ar.w * br.w) < 0 and -1 or 1
+        local rx, ry, rz, rw = normalized4(ar.x * (1 - s) + br.x * sign * s, ar.y * (1 - s) + br.y * sign * s,
+            ar.z * (1 - s) + br.z * sign * s, ar.w * (1 - s) + br.w * sign * s)
+        return setTransform(out, a.p.x + (b.p.x - a.p.x) * s, a.p.y + (b.p.y - a.p.y) * s,
+            a.p.z + (b.p.z - a.p.z) * s, rx, ry, rz, rw)
+    end,
+    -- as glm::slerp: short way, linear when the rotations are almost equal
+    slerp = function(a, b, s, out)
+        checkTransform(a, 1)
+        checkTransform(b, 2)
+        s = checkNumber(s, 3)
+        local ar, br = a.r, b.r
+        local bx, by, bz, bw = br.x, br.y, br.z, br.w
+        local cosTheta = ar.x * bx + ar.y * by + ar.z * bz + ar.w * bw
+        if cosTheta < 0 then
+            bx, by, bz, bw, cosTheta = -bx, -by, -bz, -bw, -cosTheta
+        end
+        local ka, kb = 1 - s, s
+        if cosTheta <= 1 - 1.1920929e-07 then
+            local angle = acos(cosTheta)
+            ka, kb = sin((1 - s) * angle) / sin(angle), sin(s * angle) / sin(angle)
+        end
+        return setTransform(out, a.p.x + (b.p.x - a.p.x) * s, a.p.y + (b.p.y - a.p.y) * s,
+            a.p.z + (b.p.z - a.p.z) * s, ar.x * ka + bx * kb, ar.y * ka + by * kb, ar.z * ka + bz * kb,
+            ar.w * ka + bw * kb)
+    end,
+}
+
+Transform = ffi.metatype("Transform", {
+    -- t.pos and t.rot are copies, as on the 5.4 backend
+    __index = function(t, key)
+        if key == "pos" then
+            return Vec3(t.p)
+        elseif key == "rot" then
+            return Quat(t.r)
+        end
+        return transformMethods[key]
+    end,
+    __newindex = function(t, key, value)
+        if key == "pos" then
+            t.p = checkVec3(value, 3)
+        elseif key == "rot" then
+            t.r = normalize(checkQuat(value, 3))
+        else
+            error("Transform has no field '" .. tostring(key) .. "'", 2)
+        end
+    end,
+    -- a * b composes, t * v transforms a point
+    __mul = function(a, b)
+        if isVec3(b) then
+            return transformPoint(a, b)
+        end
+        return compose(a, b)
+    end,
+    __tostring = function(t)
+        return "transform(" .. tostring(Vec3(t.p)) .. ", " .. tostring(Quat(t.r)) .. ")"
+    end,
+})
+
+-- transform([pos [, rot]]) -> identity when no arguments
+function transform(pos, rot)
+    local t = Transform()
+    t.r.w = 1
+    if pos ~= nil then
+        t.p = checkVec3(pos, 1)
+    end
+    if rot ~= nil then
+        t.r = checkQuat(rot, 2)
+    end
+    return t
+end
+
+--
+-- SPLINE
+--
+
+-- f(value) or f({values} [, out]) -> out
+local function floatBatch(f)
+    return function(x, out)
+        if type(x) ~= "table" then
+            return f(checkNumber(x, 1))
+        end
+        out = out or {}
+        for i = 1, #x do
+            out[i] = f(x[i])
+        end
+        return out
+    end
+end
+
+function roadSplineLength() return C.ffiRoadSplineLength() end
+function roadSplineNumSegments() return C.ffiRoadSplineNumSegments() end
+roadSplineDistanceToKey = floatBatch(C.ffiRoadSplineDistanceToKey)
+roadSplineKeyToDistance = floatBatch(C.ffiRoadSplineKeyToDistance)
+
+-- roadSplinePositionAtKey(key [, out vec3]) -> vec3
+-- roadSplinePositionAtKey({keys} [, out]) -> out
+function roadSplinePositionAtKey(key, out)
+    if type(key) == "table" then
+        out = out or {}
+        for i = 1, #key do
+            out[i] = roadSplinePositionAtKey(key[i], out[i])
+        end
+        return out
+    end
+    if not isVec3(out) then
+        out = Vec3()
+    end
+    C.ffiRoadSplinePositionAtKey(checkNumber(key, 1), out)
+    return out
+end
+
+-- roadSplinePositionAndRotationAtKey(key [, out vec3, out quat]) -> vec3, quat
+function roadSplinePositionAndRotationAtKey(key, pos, rot)
+    if not (isVec3(pos) and isQuat(rot)) then
+        pos, rot = Vec3(), Quat()
+    end
+    C.ffiRoadSplinePositionAndRotationAtKey(checkNumber(key, 1), pos, rot)
+    return pos, rot
+end
+
+-- roadSplineKeyClosestToPosition(vec3) -> key
+-- roadSplineKeyClosestToPosition({positions} [, out]) -> out
+function roadSplineKeyClosestToPosition(pos, out)
+    if type(pos) == "table" then
+        out = out or {}
+        for i = 1, #pos do
+            out[i] = C.ffiRoadSplineKeyClosestToPosition(checkVec3(pos[i], 1))
+        end
+        return out
+    end
+    return C.ffiRoadSplineKeyClosestToPosition(checkVec3(pos, 1))
+end
+
+return true
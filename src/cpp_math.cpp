@@ -113,24 +113,67 @@ Spline::BerierInterp Spline::GetInterpAtKey(Float splineKey) const
 
 Vec3 Spline::BerierInterp::getPos() const { return BezierPos(points[i0].p, points[i0].t, points[i1].p, points[i1].t, param); }
 Vec3 Spline::BerierInterp::getDeriv() const { return BezierDeriv(points[i0].p, points[i0].t, points[i1].p, points[i1].t, param); }
-void Spline::BerierInterp::getFrame(Vec3& forward, Vec3& right, Vec3& up) const
+inline void GetFrame(const Vec3& deriv, Float roll0, Float roll1, Float param, Vec3& forward, Vec3& right, Vec3& up)
 {
     const Vec3 worldZ(0, 0, 1);
-    const Vec3 forw = glm::normalize(getDeriv());
+    const Vec3 forw = glm::normalize(deriv);
     const Vec3 baseX = glm::normalize(glm::cross(worldZ, forw));
     const Vec3 baseY = glm::cross(forw, baseX);
 
+    forward = forw;
+
+    if (roll0 == 0 && roll1 == 0) { // flat track, skip trig
+        right = baseX;
+        up = baseY;
+        return;
+    }
+
     const Float hermiteParam = glm::smoothstep(Float(0), Float(1), glm::fract(param));
-    const Float roll = glm::mix(points[i0].roll, points[i1].roll, hermiteParam);
+    const Float roll = glm::mix(roll0, roll1, hermiteParam);
     const Float c = cos(roll), s = sin(roll);
     const Vec3 x = (c * baseX) - (s * baseY);
     const Vec3 y = (c * baseY) + (s * baseX);
 
-    forward = forw;
     right = x;
     up = y;
 }
 
+void Spline::BerierInterp::getFrame(Vec3& forward, Vec3& right, Vec3& up) const
+{
+    GetFrame(getDeriv(), points[i0].roll, points[i1].roll, param, forward, right, up);
+}
+
+Quat Spline::BerierInterp::getRotation() const
+{
+    Vec3 forward, right, up;
+    getFrame(forward, right, up);
+    return glm::quat_cast(Mat3(forward, right, up));
+}
+
+// BezierPos and BezierDeriv collected by powers of the param
+Spline::Segment Spline::BerierInterp::getSegment() const
+{
+    const Vec3 &p0 = points[i0].p, &t0 = points[i0].t, &p1 = points[i1].p, &t1 = points[i1].t;
+    Segment s;
+    s.pos[0] = Float(2) * p0 + t0 + t1 - Float(2) * p1;
+    s.pos[1] = Float(-3) * p0 - Float(2) * t0 - t1 + Float(3) * p1;
+    s.pos[2] = t0;
+    s.pos[3] = p0;
+    s.deriv[0] = Float(6) * p0 + Float(3) * t0 + Float(3) * t1 - Float(6) * p1;
+    s.deriv[1] = Float(-6) * p0 - Float(4) * t0 - Float(2) * t1 + Float(6) * p1;
+    s.deriv[2] = t0;
+    s.roll0 = points[i0].roll;
+    s.roll1 = points[i1].roll;
+    return s;
+}
+
+Quat Spline::Segment::getRotation(Float param) const
+{
+    Vec3 forward, right, up;
+    GetFrame(getDeriv(param), roll0, roll1, param, forward, right, up);
+    return glm::quat_cast(Mat3(forward, right, up));
+}
+
 void ClosestPoint(const Vec3& a, const Vec3& b, const Vec3& c, const Vec3& d,
     const Vec3& WorldPos, Float& outParam, Float& outMinDistSquared);
 
@@ -155,8 +198,8 @@ Float Spline::GetKeyClosestToPosition(const Vec3& worldPos, int segmentIndexPrev
     };
 
     if (segmentIndexPrev == INT_MAX) {
-        for (int attemptIndex = 0; attemptIndex < numSegmemts; ++attemptIndex)
-            findClosest(correctModulo(segmentIndexPrev + attemptIndex, numSegmemts));
+        for (int segmentIndex = 0; segmentIndex < numSegmemts; ++segmentIndex)
+            findClosest(segmentIndex);
 
     } else {
         for (int attemptIndex = -1; attemptIndex <= 1; ++attemptIndex)
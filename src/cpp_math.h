@@ -12,6 +12,22 @@ typedef glm::vec<2, Float, glm::defaultp> Vec2;
 typedef glm::vec<3, Float, glm::defaultp> Vec3;
 typedef glm::vec<4, Float, glm::defaultp> Vec4;
 typedef glm::qua<Float, glm::defaultp> Quat;
+typedef glm::mat<3, 3, Float, glm::defaultp> Mat3;
+
+// rotate, then translate; rot is kept unit length
+struct Transform {
+    Vec3 pos { 0 };
+    Quat rot { 1, 0, 0, 0 };
+
+    Vec3 transformPoint(const Vec3& p) const { return pos + rot * p; }
+    Vec3 inverseTransformPoint(const Vec3& p) const { return glm::conjugate(rot) * (p - pos); }
+    Transform operator*(const Transform& b) const { return { transformPoint(b.pos), rot * b.rot }; } // b, then this
+    Transform inverse() const
+    {
+        const Quat inv = glm::conjugate(rot);
+        return { inv * -pos, inv };
+    }
+};
 
 struct BezierPoint {
     Vec3 p, t;
@@ -29,6 +45,18 @@ class Spline {
     Float m_splineLength = 0.0;
 
 public:
+    // one segment as polynomials in its param, for evaluating many params of
+    // the same segment without redoing the Hermite weights
+    struct Segment {
+        Vec3 pos[4]; // a^3, a^2, a, 1
+        Vec3 deriv[3]; // a^2, a, 1
+        Float roll0, roll1;
+
+        Vec3 getPos(Float param) const { return ((pos[0] * param + pos[1]) * param + pos[2]) * param + pos[3]; }
+        Vec3 getDeriv(Float param) const { return (deriv[0] * param + deriv[1]) * param + deriv[2]; }
+        Quat getRotation(Float param) const;
+    };
+
     struct BerierInterp {
         const BezierPoint* points;
         const int i0, i1;
@@ -45,6 +73,8 @@ public:
         Vec3 getPos() const;
         Vec3 getDeriv() const; // unnormalized tangent
         void getFrame(Vec3& forward, Vec3& right, Vec3& up) const;
+        Quat getRotation() const; // rotates local X, Y, Z onto forward, right, up
+        Segment getSegment() const; // the segment from i0 to i1
         bool isValid() const { return !!points; }
     };
 
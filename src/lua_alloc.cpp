@@ -0,0 +1,220 @@
+#include "lua_alloc.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+
+extern "C" {
+#include <lua.h>
+}
+
+namespace {
+constexpr size_t sizeClassStep = 16;
+constexpr int numSizeClasses = LuaAllocator::maxPooledSize / sizeClassStep;
+constexpr size_t slabSize = 64 * 1024;
+constexpr int batchSize = 64; // blocks moved between a thread cache and the shared pool
+
+int sizeClassOf(size_t size) { return int((size + sizeClassStep - 1) / sizeClassStep) - 1; }
+size_t blockSizeOf(int sizeClass) { return (sizeClass + 1) * sizeClassStep; }
+
+struct FreeBlock {
+    FreeBlock* next;
+};
+
+// process-wide free lists, refilled by carving new slabs
+class SharedPool {
+    std::mutex m_mutex;
+    FreeBlock* m_freeLists[numSizeClasses] = {};
+
+public:
+    // pops up to count blocks onto list, returns how many were moved
+    int take(int sizeClass, FreeBlock*& list, int count)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        FreeBlock*& freeList = m_freeLists[sizeClass];
+        if (!freeList && !carveSlab(sizeClass))
+            return 0;
+
+        int moved = 0;
+        while (freeList && moved < count) {
+            FreeBlock* block = freeList;
+            freeList = block->next;
+            block->next = list;
+            list = block;
+            ++moved;
+        }
+        return moved;
+    }
+
+    // pushes the chain first..last
+    void give(int sizeClass, FreeBlock* first, FreeBlock* last)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        last->next = m_freeLists[sizeClass];
+        m_freeLists[sizeClass] = first;
+    }
+
+private:
+    bool carveSlab(int sizeClass)
+    {
+        char* slab = (char*)malloc(slabSize);
+        if (!slab)
+            return false;
+
+        const size_t blockSize = blockSizeOf(sizeClass);
+        const size_t numBlocks = slabSize / blockSize;
+        for (size_t i = 0; i < numBlocks; ++i) {
+            FreeBlock* block = (FreeBlock*)(slab + i * blockSize);
+            block->next = m_freeLists[sizeClass];
+            m_freeLists[sizeClass] = block;
+        }
+        return true;
+    }
+};
+
+// leaked on purpose: thread caches flush into it from thread_local destructors
+SharedPool& sharedPool()
+{
+    static SharedPool* pool = new SharedPool;
+    return *pool;
+}
+
+// per-thread free lists, so states on different threads rarely touch the mutex
+struct ThreadCache {
+    FreeBlock* lists[numSizeClasses] = {};
+    int counts[numSizeClasses] = {};
+
+    ~ThreadCache()
+    {
+        for (int c = 0; c < numSizeClasses; ++c)
+            if (lists[c])
+                release(c, counts[c]);
+    }
+
+    void* pop(int sizeClass)
+    {
+        if (!lists[sizeClass])
+            counts[sizeClass] += sharedPool().take(sizeClass, lists[sizeClass], batchSize);
+
+        FreeBlock* block = lists[sizeClass];
+        if (!block)
+            return nullptr;
+        lists[sizeClass] = block->next;
+        --counts[sizeClass];
+        return block;
+    }
+
+    void push(int sizeClass, void* p)
+    {
+        FreeBlock* block = (FreeBlock*)p;
+        block->next = lists[sizeClass];
+        lists[sizeClass] = block;
+        if (++counts[sizeClass] > 2 * batchSize)
+            release(sizeClass, batchSize);
+    }
+
+    // hands the first count blocks back to the shared pool
+    void release(int sizeClass, int count)
+    {
+        FreeBlock* first = lists[sizeClass];
+        FreeBlock* last = first;
+        for (int i = 1; i < count; ++i)
+            last = last->next;
+        lists[sizeClass] = last->next;
+        counts[sizeClass] -= count;
+        sharedPool().give(sizeClass, first, last);
+    }
+};
+
+thread_local ThreadCache threadCache;
+
+bool isPooled(size_t size) { return size && size <= LuaAllocator::maxPooledSize; }
+
+void release(void* ptr, size_t size)
+{
+    if (isPooled(size))
+        threadCache.push(sizeClassOf(size), ptr);
+    else
+        free(ptr);
+}
+
+void* reallocate(void* ptr, size_t osize, size_t nsize)
+{
+    if (nsize == 0) {
+        if (ptr)
+            release(ptr, osize);
+        return nullptr;
+    }
+
+    const bool newPooled = isPooled(nsize);
+    if (!ptr)
+        return newPooled ? threadCache.pop(sizeClassOf(nsize)) : malloc(nsize);
+
+    const bool oldPooled = isPooled(osize);
+    if (oldPooled && newPooled && sizeClassOf(osize) == sizeClassOf(nsize))
+        return ptr;
+    if (!oldPooled && !newPooled)
+        return realloc(ptr, nsize);
+
+    void* p = newPooled ? threadCache.pop(sizeClassOf(nsize)) : malloc(nsize);
+    if (!p) {
+        // Lua requires shrinking to succeed: keep the larger block. It is
+        // released later by nsize, into a pool it is big enough for; pools
+        // never hand memory back, so a malloc'd block there is just reused.
+        return nsize <= osize ? ptr : nullptr;
+    }
+    memcpy(p, ptr, std::min(osize, nsize));
+    release(ptr, osize);
+    return p;
+}
+
+int panic(lua_State* L)
+{
+    const char* msg = lua_tostring(L, -1);
+    fprintf(stderr, "PANIC: unprotected error in call to Lua API (%s)\n", msg ? msg : "error object is not a string");
+    return 0;
+}
+} // namespace
+
+void* LuaAllocator::alloc(void* ud, void* ptr, size_t osize, size_t nsize)
+{
+    LuaAllocator* self = (LuaAllocator*)ud;
+    if (!ptr)
+        osize = 0; // osize encodes the object type for new blocks
+
+    void* result = reallocate(ptr, osize, nsize);
+    if (nsize && !result)
+        return nullptr;
+
+    Stats& stats = self->m_stats;
+    stats.bytesLive = stats.bytesLive + nsize - osize;
+    stats.bytesPeak = std::max(stats.bytesPeak, stats.bytesLive);
+    if (!ptr) {
+        ++stats.allocations;
+        ++stats.frameAllocations;
+    } else if (!nsize) {
+        ++stats.frees;
+        ++stats.frameFrees;
+    }
+    return result;
+}
+
+lua_State* LuaAllocator::newState()
+{
+    lua_State* L = lua_newstate(alloc, this);
+    if (L)
+        lua_atpanic(L, panic);
+    return L;
+}
+
+void LuaAllocator::endFrame()
+{
+    m_liveKbHistory[m_historyOffset] = m_stats.bytesLive / 1024.0f;
+    m_allocationsHistory[m_historyOffset] = (float)m_stats.frameAllocations;
+    m_historyOffset = (m_historyOffset + 1) % historySize;
+
+    m_stats.frameAllocations = 0;
+    m_stats.frameFrees = 0;
+}
@@ -0,0 +1,50 @@
+#ifndef LUA_ALLOC_H
+#define LUA_ALLOC_H
+
+#include <cstddef>
+#include <cstdint>
+
+struct lua_State;
+
+// lua_Alloc for one lua_State. Blocks up to maxPooledSize bytes (Vec3/Quat
+// userdata, small tables and strings) come from 16-byte size-class slabs shared
+// by the process, through a per-thread cache; larger blocks go to realloc.
+// Slabs are kept for reuse and never returned to the system.
+class LuaAllocator {
+public:
+    static constexpr size_t maxPooledSize = 256;
+    static constexpr int historySize = 240; // frames
+
+    struct Stats {
+        size_t bytesLive = 0;
+        size_t bytesPeak = 0;
+        uint64_t allocations = 0; // new blocks, reallocs not counted
+        uint64_t frees = 0;
+        uint64_t frameAllocations = 0; // since the last endFrame
+        uint64_t frameFrees = 0;
+    };
+
+    // lua_Alloc, ud is the LuaAllocator
+    static void* alloc(void* ud, void* ptr, size_t osize, size_t nsize);
+
+    // like luaL_newstate, the allocator must outlive the state
+    lua_State* newState();
+
+    const Stats& getStats() const { return m_stats; }
+
+    // pushes the frame counters into the history and resets them
+    void endFrame();
+
+    // ring buffers for ImGui::PlotLines, oldest value at getHistoryOffset()
+    const float* getLiveKbHistory() const { return m_liveKbHistory; }
+    const float* getAllocationsHistory() const { return m_allocationsHistory; }
+    int getHistoryOffset() const { return m_historyOffset; }
+
+private:
+    Stats m_stats;
+    float m_liveKbHistory[historySize] = {};
+    float m_allocationsHistory[historySize] = {};
+    int m_historyOffset = 0;
+};
+
+#endif // LUA_ALLOC_H
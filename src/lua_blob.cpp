@@ -0,0 +1,50 @@
+#include "lua_blob.h"
+
+extern "C" {
+#include <lua.h>
+}
+
+LuaBlob::Builder& LuaBlob::Builder::floats(const char* name, const Float* values, int size)
+{
+    m_arrays.push_back({ name, Kind::Floats, size, m_floats.size() });
+    m_floats.insert(m_floats.end(), values, values + size);
+    return *this;
+}
+
+LuaBlob::Builder& LuaBlob::Builder::vec3s(const char* name, const Vec3* values, int size)
+{
+    m_arrays.push_back({ name, Kind::Vec3s, size, m_floats.size() });
+    m_floats.resize(m_floats.size() + 3 * size);
+    Float* x = m_floats.data() + m_arrays.back().offset;
+    Float *y = x + size, *z = y + size;
+    for (int i = 0; i < size; ++i)
+        x[i] = values[i].x, y[i] = values[i].y, z[i] = values[i].z;
+    return *this;
+}
+
+int LuaBlob::Builder::string(const std::string& s)
+{
+    m_chars += s;
+    m_stringEnds.push_back((uint32_t)m_chars.size());
+    return (int)m_stringEnds.size();
+}
+
+LuaBlob LuaBlob::Builder::build()
+{
+    LuaBlob blob;
+    blob.m_floats = std::move(m_floats);
+    blob.m_arrays = std::move(m_arrays);
+    blob.m_chars = std::move(m_chars);
+    blob.m_stringEnds = std::move(m_stringEnds);
+    m_floats.clear(), m_arrays.clear(), m_chars.clear(), m_stringEnds.clear();
+    return blob;
+}
+
+// the registry marks which lightuserdata are blobs, the bindings check it
+void setLuaBlob(lua_State* L, const char* name, const LuaBlob& blob)
+{
+    lua_pushboolean(L, 1);
+    lua_rawsetp(L, LUA_REGISTRYINDEX, &blob);
+    lua_pushlightuserdata(L, (void*)&blob);
+    lua_setglobal(L, name);
+}
@@ -0,0 +1,80 @@
+#ifndef LUA_BLOB_H
+#define LUA_BLOB_H
+
+#include "cpp_math.h"
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+struct lua_State;
+
+// Read-only data built once in C++ and read by any number of lua_States,
+// e.g. lookup tables and waypoint lists every bot worker needs. Named float
+// and Vec3 arrays share one flat buffer (Vec3 arrays as x, y, z planes), and
+// strings are packed into one table. A state sees the blob as a lightuserdata
+// global; blobFloats/blobVec3s hand out read-only FloatArray/Vec3Array views
+// straight into the buffer, so nothing is copied per state. The blob must
+// outlive every state it is set on.
+class LuaBlob {
+public:
+    enum class Kind : uint8_t { Floats, Vec3s };
+
+    struct Array {
+        std::string name;
+        Kind kind;
+        int size;
+        size_t offset; // into the float buffer
+    };
+
+    class Builder {
+    public:
+        Builder& floats(const char* name, const Float* values, int size);
+        Builder& vec3s(const char* name, const Vec3* values, int size);
+
+        // index into the string table, 1-based as seen from Lua
+        int string(const std::string& s);
+
+        LuaBlob build();
+
+    private:
+        std::vector<Float> m_floats;
+        std::vector<Array> m_arrays;
+        std::string m_chars;
+        std::vector<uint32_t> m_stringEnds;
+    };
+
+    // x, y, z planes of `size` each for Vec3s; nullptr if there is no such array
+    const Float* find(const char* name, Kind kind, int& size) const
+    {
+        for (const Array& arr : m_arrays)
+            if (arr.kind == kind && strcmp(arr.name.c_str(), name) == 0) {
+                size = arr.size;
+                return m_floats.data() + arr.offset;
+            }
+        return nullptr;
+    }
+
+    const std::vector<Array>& getArrays() const { return m_arrays; }
+    int getNumStrings() const { return (int)m_stringEnds.size(); }
+
+    // i is 0-based
+    const char* getString(int i, size_t& length) const
+    {
+        const uint32_t begin = i > 0 ? m_stringEnds[i - 1] : 0;
+        length = m_stringEnds[i] - begin;
+        return m_chars.data() + begin;
+    }
+
+private:
+    std::vector<Float> m_floats;
+    std::vector<Array> m_arrays;
+    std::string m_chars;
+    std::vector<uint32_t> m_stringEnds;
+};
+
+// sets global `name` to the blob and lets the blob* bindings accept it in L
+void setLuaBlob(lua_State* L, const char* name, const LuaBlob& blob);
+
+#endif // LUA_BLOB_H
@@ -0,0 +1,143 @@
+#include "lua_cache.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+
+extern "C" {
+#include <lauxlib.h>
+#include <lua.h>
+}
+
+namespace {
+const char cacheMagic[4] = { 'L', 'C', 'C', 'H' };
+
+struct CacheHeader {
+    char magic[4];
+    uint32_t luaVersion;
+    uint64_t sourceHash;
+    uint64_t sourceSize;
+};
+
+uint64_t fnv1a(const std::string& data)
+{
+    uint64_t hash = 14695981039346656037ull;
+    for (unsigned char c : data) {
+        hash ^= c;
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+bool readFile(const std::string& path, std::string& out)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+        return false;
+    out.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    return true;
+}
+
+int writeChunk(lua_State*, const void* p, size_t size, void* ud)
+{
+    ((std::string*)ud)->append((const char*)p, size);
+    return 0;
+}
+
+// best effort: a read-only script directory just means no cache
+void writeCache(lua_State* L, const std::string& cachePath, const CacheHeader& header)
+{
+    std::string data((const char*)&header, sizeof(header));
+    if (lua_dump(L, writeChunk, &data, 0) != 0)
+        return;
+
+    // per-state temp name, worker states may compile the same script at once
+    const std::string tmpPath = cachePath + "." + std::to_string((uintptr_t)L) + ".tmp";
+    {
+        std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+        if (!file.write(data.data(), data.size()))
+            return;
+    }
+    if (std::rename(tmpPath.c_str(), cachePath.c_str()) != 0) {
+        std::remove(cachePath.c_str());
+        if (std::rename(tmpPath.c_str(), cachePath.c_str()) != 0)
+            std::remove(tmpPath.c_str());
+    }
+}
+
+int cachedSearcher(lua_State* L)
+{
+    const char* name = luaL_checkstring(L, 1);
+    lua_getglobal(L, "package");
+    lua_getfield(L, -1, "searchpath");
+    lua_pushstring(L, name);
+    lua_getfield(L, -3, "path");
+    lua_call(L, 2, 2);
+    if (lua_isnil(L, -2))
+        return 1; // "no file ..." message
+
+    const char* filename = lua_tostring(L, -2);
+    if (loadLuaFileCached(L, filename) != LUA_OK)
+        return luaL_error(L, "error loading module '%s' from file '%s':\n\t%s", name, filename, lua_tostring(L, -1));
+    lua_pushstring(L, filename);
+    return 2;
+}
+} // namespace
+
+int loadLuaFileCached(lua_State* L, const char* path)
+{
+    std::string source;
+    if (!readFile(path, source)) {
+        lua_pushfstring(L, "cannot open %s", path);
+        return LUA_ERRFILE;
+    }
+
+    const std::string chunkname = std::string("@") + path;
+    const std::string cachePath = std::string(path) + "c";
+    CacheHeader header;
+    memcpy(header.magic, cacheMagic, sizeof(cacheMagic));
+    header.luaVersion = LUA_VERSION_NUM;
+    header.sourceHash = fnv1a(source);
+    header.sourceSize = source.size();
+
+    std::string cache;
+    if (readFile(cachePath, cache) && cache.size() > sizeof(CacheHeader)
+        && memcmp(cache.data(), &header, sizeof(CacheHeader)) == 0) {
+        const char* bytecode = cache.data() + sizeof(CacheHeader);
+        if (luaL_loadbufferx(L, bytecode, cache.size() - sizeof(CacheHeader), chunkname.c_str(), "b") == LUA_OK)
+            return LUA_OK;
+        lua_pop(L, 1); // stale or foreign bytecode, recompile
+    }
+
+    const int status = luaL_loadbufferx(L, source.data(), source.size(), chunkname.c_str(), "t");
+    if (status == LUA_OK)
+        writeCache(L, cachePath, header);
+    return status;
+}
+
+int doLuaFileCached(lua_State* L, const char* path)
+{
+    const int status = loadLuaFileCached(L, path);
+    return status != LUA_OK ? status : lua_pcall(L, 0, LUA_MULTRET, 0);
+}
+
+bool hashLuaFile(const char* path, uint64_t& hash)
+{
+    std::string source;
+    if (!readFile(path, source))
+        return false;
+    hash = fnv1a(source);
+    return true;
+}
+
+void installCachedSearcher(lua_State* L)
+{
+    lua_getglobal(L, "package");
+    lua_getfield(L, -1, "searchers");
+    lua_pushcfunction(L, cachedSearcher);
+    lua_rawseti(L, -2, 2); // the package.path searcher, after preload
+    lua_pop(L, 2);
+}
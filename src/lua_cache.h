@@ -0,0 +1,25 @@
+#ifndef LUA_CACHE_H
+#define LUA_CACHE_H
+
+#include <cstdint>
+
+struct lua_State;
+
+// Bytecode cache keyed by script content. The lua_dump output of "x.lua" is
+// kept next to it as "x.luac", prefixed with the FNV-1a hash of the source;
+// a cache whose hash differs or that fails to load is rebuilt from source.
+// Debug info is kept so errors still report file and line.
+
+// like luaL_loadfile
+int loadLuaFileCached(lua_State* L, const char* path);
+
+// like luaL_dofile
+int doLuaFileCached(lua_State* L, const char* path);
+
+// the cache key of a script: FNV-1a of its content; false if it cannot be read
+bool hashLuaFile(const char* path, uint64_t& hash);
+
+// replaces the package.path searcher of require() with one going through the cache
+void installCachedSearcher(lua_State* L);
+
+#endif // LUA_CACHE_H
@@ -0,0 +1,24 @@
+#include "lua_ffi.h"
+
+namespace {
+Spline spline; // the same road the Lua 5.4 bindings use
+}
+
+float ffiRoadSplineLength() { return spline.GetLength(); }
+int ffiRoadSplineNumSegments() { return (int)spline.GetNumSegments(); }
+float ffiRoadSplineDistanceToKey(float distance) { return spline.DistanceToKey(distance); }
+float ffiRoadSplineKeyToDistance(float key) { return spline.KeyToDistance(key); }
+
+void ffiRoadSplinePositionAtKey(float key, Vec3* out)
+{
+    *out = spline.GetInterpAtKey(key).getPos();
+}
+
+void ffiRoadSplinePositionAndRotationAtKey(float key, Vec3* pos, Quat* rot)
+{
+    const auto interp = spline.GetInterpAtKey(key);
+    *pos = interp.getPos();
+    *rot = interp.getRotation();
+}
+
+float ffiRoadSplineKeyClosestToPosition(const Vec3* pos) { return spline.GetKeyClosestToPosition(*pos); }
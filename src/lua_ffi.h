@@ -0,0 +1,22 @@
+#ifndef LUA_FFI_H
+#define LUA_FFI_H
+
+#include "cpp_math.h"
+
+// C entry points behind ffi_math.lua, the LuaJIT FFI backend of the math
+// bindings. Vec3, Quat and Transform are passed as the plain structs declared
+// with ffi.cdef there, which match the glm layouts. Built into the
+// lua_math_ffi library (BUILD_LUAJIT_FFI); a LuaJIT host that links this file
+// and exports its symbols is reached through ffi.C instead.
+
+extern "C" {
+float ffiRoadSplineLength();
+int ffiRoadSplineNumSegments();
+float ffiRoadSplineDistanceToKey(float distance);
+float ffiRoadSplineKeyToDistance(float key);
+void ffiRoadSplinePositionAtKey(float key, Vec3* out);
+void ffiRoadSplinePositionAndRotationAtKey(float key, Vec3* pos, Quat* rot);
+float ffiRoadSplineKeyClosestToPosition(const Vec3* pos);
+}
+
+#endif // LUA_FFI_H
@@ -2,9 +2,24 @@
 #define LUA_FUNCTIONS_H
 
 #include "cpp_math.h"
-
+#include "lua_blob.h"
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
 #include <cstring>
 #include <iostream>
+#include <optional>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 extern "C" {
 #include <lauxlib.h>
@@ -107,11 +122,332 @@ public:
 };
 } // namespace
 
-#define LUA_GET_INPUT(type, name, index) type* name = (type*)luaL_checkudata(L, index, #type "Meta")
+//
+// METATABLES
+//
+// Every binding is pushed as a closure that carries all metatables as upvalues,
+// so constructors and type checks never touch the string-keyed registry.
+// Host code (no upvalues) reaches them via lightuserdata registry keys.
+//
+namespace {
+enum MetaUpvalue {
+    Vec3MetaUpvalue = 1,
+    QuatMetaUpvalue,
+    Arr2dMetaUpvalue,
+    FloatArrayMetaUpvalue,
+    Vec3ArrayMetaUpvalue,
+    Arr2dViewMetaUpvalue,
+    Arr2dGridMetaUpvalue,
+    Arr2dIndexMetaUpvalue,
+    TransformMetaUpvalue,
+    KernelMetaUpvalue,
+    MetaUpvalueCount = KernelMetaUpvalue
+};
+
+const char* const metaNames[MetaUpvalueCount + 1] = {
+    nullptr, "Vec3Meta", "QuatMeta", "Arr2d", "FloatArrayMeta", "Vec3ArrayMeta", "Arr2dViewMeta",
+    "Arr2dGridMeta", "Arr2dIndexMeta", "TransformMeta", "KernelMeta"
+};
+char metaRegistryKeys[MetaUpvalueCount + 1];
+
+void pushMetatable(lua_State* L, MetaUpvalue meta)
+{
+    lua_rawgetp(L, LUA_REGISTRYINDEX, &metaRegistryKeys[meta]);
+}
+
+// pointer compare against the cached metatable, no allocation, no string hashing.
+// Bindings find the metatables in their upvalues; host code, outside any math
+// closure (LuaFunction results, luaDecode), passes fromRegistry.
+void* testUdata(lua_State* L, int index, MetaUpvalue meta, bool fromRegistry = false)
+{
+    void* p = lua_touserdata(L, index);
+    if (!p || !lua_getmetatable(L, index))
+        return nullptr;
+
+    bool match;
+    if (fromRegistry) {
+        pushMetatable(L, meta);
+        match = lua_rawequal(L, -1, -2);
+        lua_pop(L, 2);
+    } else {
+        match = lua_topointer(L, -1) == lua_topointer(L, lua_upvalueindex(meta));
+        lua_pop(L, 1);
+    }
+    return match ? p : nullptr;
+}
+
+void* checkUdata(lua_State* L, int index, MetaUpvalue meta)
+{
+    void* p = testUdata(L, index, meta);
+    if (!p)
+        luaL_typeerror(L, index, metaNames[meta]);
+    return p;
+}
+
+void* newUdata(lua_State* L, size_t size, MetaUpvalue meta, int numUserValues = 0)
+{
+    void* p = lua_newuserdatauv(L, size, numUserValues);
+    lua_pushvalue(L, lua_upvalueindex(meta));
+    lua_setmetatable(L, -2);
+    return p;
+}
+
+// pushes f as a closure with all metatables as upvalues, followed by
+// numExtraUpvalues values taken from the top of the stack
+void pushMathFunction(lua_State* L, lua_CFunction f, int numExtraUpvalues = 0)
+{
+    for (int meta = 1; meta <= MetaUpvalueCount; ++meta)
+        pushMetatable(L, (MetaUpvalue)meta);
+    if (numExtraUpvalues)
+        lua_rotate(L, -(MetaUpvalueCount + numExtraUpvalues), MetaUpvalueCount);
+    lua_pushcclosure(L, f, MetaUpvalueCount + numExtraUpvalues);
+}
+
+void registerMathFunction(lua_State* L, const char* name, lua_CFunction f)
+{
+    pushMathFunction(L, f);
+    lua_setglobal(L, name);
+}
+} // namespace
+
+#define LUA_GET_INPUT(type, name, index) type* name = (type*)checkUdata(L, index, type##MetaUpvalue)
+#define LUA_TEST_INPUT(type, index) ((type*)testUdata(L, index, type##MetaUpvalue))
 #define LUA_GET_FLOAT(name, index) Float name = (Float)luaL_checknumber(L, index)
 
-#define LUA_GET_OUTPUT(type) type* outptr = (type*)lua_newuserdata(L, sizeof(type))
+#define LUA_GET_OUTPUT(type) type* outptr = (type*)newUdata(L, sizeof(type), type##MetaUpvalue)
 #define LUA_SET_FLOAT(name) lua_pushnumber(L, name)
+
+//
+// BINDINGS
+//
+// bind<&f> and bindMethod<&object, &Class::f> generate a lua_CFunction from the
+// C++ signature: LuaTraits<T> checks each argument and pushes the result
+// (tuples push several). bindOut<&f> also takes an optional out userdata after
+// the inputs, like the hand-written "[, out]" forms, and writes a userdata
+// result into it; plain bind ignores extra arguments.
+// overloads<...> calls the first candidate whose arguments match.
+//
+// LuaTraits<T> is the one conversion layer for a C++ type, shared with the
+// host side (LuaFunction, luaDecode):
+//   test/check  argument of a binding, inside a math closure
+//   push        result of a binding; a userdata result goes into the userdata
+//               at outIndex when it has the type (0: never)
+//   get         value from host code, false on a type mismatch
+//   pushSlot    argument of a LuaFunction call; pooled types are written into
+//               the per-slot userdata made by newSlot
+//
+namespace {
+template <typename T, typename = void>
+struct LuaTraits;
+
+template <typename T>
+struct LuaTraits<T, std::enable_if_t<std::is_arithmetic_v<T> && !std::is_same_v<T, bool>>> {
+    static constexpr int numValues = 1;
+    static constexpr bool pooled = false;
+    static bool test(lua_State* L, int index) { return lua_isnumber(L, index); }
+    static T check(lua_State* L, int index)
+    {
+        if constexpr (std::is_integral_v<T>)
+            return (T)luaL_checkinteger(L, index);
+        else
+            return (T)luaL_checknumber(L, index);
+    }
+    static int push(lua_State* L, T v, int /*outIndex*/)
+    {
+        if constexpr (std::is_integral_v<T>)
+            lua_pushinteger(L, (lua_Integer)v);
+        else
+            lua_pushnumber(L, (lua_Number)v);
+        return 1;
+    }
+    static bool get(lua_State* L, int index, T& out)
+    {
+        int isNum = 0;
+        if constexpr (std::is_integral_v<T>)
+            out = (T)lua_tointegerx(L, index, &isNum);
+        else
+            out = (T)lua_tonumberx(L, index, &isNum);
+        return isNum;
+    }
+    static void pushSlot(lua_State* L, T v, int /*slotRef*/) { push(L, v, 0); }
+};
+
+template <>
+struct LuaTraits<bool> {
+    static constexpr int numValues = 1;
+    static constexpr bool pooled = false;
+    static bool test(lua_State*, int) { return true; }
+    static bool check(lua_State* L, int index) { return lua_toboolean(L, index); }
+    static int push(lua_State* L, bool v, int /*outIndex*/)
+    {
+        lua_pushboolean(L, v);
+        return 1;
+    }
+    static bool get(lua_State* L, int index, bool& out)
+    {
+        out = lua_toboolean(L, index);
+        return true;
+    }
+    static void pushSlot(lua_State* L, bool v, int /*slotRef*/) { lua_pushboolean(L, v); }
+};
+
+template <typename T, MetaUpvalue meta>
+struct LuaUdataTraits {
+    static constexpr int numValues = 1;
+    static constexpr bool pooled = true;
+    static bool test(lua_State* L, int index) { return testUdata(L, index, meta); }
+    static T& check(lua_State* L, int index) { return *(T*)checkUdata(L, index, meta); }
+    static int push(lua_State* L, const T& v, int outIndex)
+    {
+        if (T* out = outIndex ? (T*)testUdata(L, outIndex, meta) : nullptr) {
+            *out = v;
+            lua_pushvalue(L, outIndex);
+        } else {
+            *(T*)newUdata(L, sizeof(T), meta) = v;
+        }
+        return 1;
+    }
+    static bool get(lua_State* L, int index, T& out)
+    {
+        const T* p = (const T*)testUdata(L, index, meta, true);
+        if (p)
+            out = *p;
+        return p;
+    }
+    static int newSlot(lua_State* L)
+    {
+        *(T*)lua_newuserdatauv(L, sizeof(T), 0) = T {};
+        pushMetatable(L, meta);
+        lua_setmetatable(L, -2);
+        return luaL_ref(L, LUA_REGISTRYINDEX);
+    }
+    static void pushSlot(lua_State* L, const T& v, int slotRef)
+    {
+        lua_rawgeti(L, LUA_REGISTRYINDEX, slotRef);
+        *(T*)lua_touserdata(L, -1) = v;
+    }
+};
+
+template <>
+struct LuaTraits<Vec3> : LuaUdataTraits<Vec3, Vec3MetaUpvalue> { };
+template <>
+struct LuaTraits<Quat> : LuaUdataTraits<Quat, QuatMetaUpvalue> { };
+template <>
+struct LuaTraits<Transform> : LuaUdataTraits<Transform, TransformMetaUpvalue> { };
+
+// tuples map to multiple values
+template <typename... Ts>
+struct LuaTraits<std::tuple<Ts...>> {
+    static constexpr int numValues = (LuaTraits<Ts>::numValues + ... + 0);
+    static int push(lua_State* L, const std::tuple<Ts...>& v, int outIndex)
+    {
+        return std::apply([&](const Ts&... elems) {
+            int n = 0;
+            ((n += LuaTraits<Ts>::push(L, elems, outIndex ? outIndex + n : 0)), ...);
+            return n;
+        },
+            v);
+    }
+    static bool get(lua_State* L, int index, std::tuple<Ts...>& out)
+    {
+        return std::apply([&](Ts&... elems) {
+            bool ok = true;
+            int i = index;
+            ((ok = ok && LuaTraits<Ts>::get(L, i, elems), i += LuaTraits<Ts>::numValues), ...);
+            return ok;
+        },
+            out);
+    }
+};
+
+template <typename R, typename... Args>
+struct LuaBindSignature {
+    static constexpr int numArgs = sizeof...(Args);
+
+    static bool matches(lua_State* L) { return matches(L, std::index_sequence_for<Args...> {}); }
+
+    template <bool Out, typename Invoke>
+    static int call(lua_State* L, Invoke invoke) { return call<Out>(L, invoke, std::index_sequence_for<Args...> {}); }
+
+private:
+    template <size_t... I>
+    static bool matches(lua_State* L, std::index_sequence<I...>)
+    {
+        return (LuaTraits<std::decay_t<Args>>::test(L, I + 1) && ...);
+    }
+
+    template <bool Out, typename Invoke, size_t... I>
+    static int call(lua_State* L, Invoke invoke, std::index_sequence<I...>)
+    {
+        if constexpr (std::is_void_v<R>) {
+            invoke(LuaTraits<std::decay_t<Args>>::check(L, I + 1)...);
+            return 0;
+        } else {
+            return LuaTraits<std::decay_t<R>>::push(L, invoke(LuaTraits<std::decay_t<Args>>::check(L, I + 1)...), Out ? numArgs + 1 : 0);
+        }
+    }
+};
+
+template <typename F>
+struct LuaSignature;
+template <typename R, typename... Args>
+struct LuaSignature<R (*)(Args...)> : LuaBindSignature<R, Args...> { };
+template <typename R, typename C, typename... Args>
+struct LuaSignature<R (C::*)(Args...)> : LuaBindSignature<R, Args...> { };
+template <typename R, typename C, typename... Args>
+struct LuaSignature<R (C::*)(Args...) const> : LuaBindSignature<R, Args...> { };
+
+// Out: a userdata result may go into an out argument after the inputs
+template <auto F, bool Out = false>
+struct LuaBind {
+    using Signature = LuaSignature<decltype(F)>;
+    static bool matches(lua_State* L) { return Signature::matches(L); }
+    static int call(lua_State* L)
+    {
+        return Signature::template call<Out>(L, [](auto&&... args) -> decltype(auto) { return F(args...); });
+    }
+};
+
+template <auto Object, auto Method, bool Out = false>
+struct LuaBindMethod {
+    using Signature = LuaSignature<decltype(Method)>;
+    static bool matches(lua_State* L) { return Signature::matches(L); }
+    static int call(lua_State* L)
+    {
+        return Signature::template call<Out>(L, [](auto&&... args) -> decltype(auto) { return (Object->*Method)(args...); });
+    }
+};
+
+// hand-written binding as an overload candidate
+template <lua_CFunction F, bool (*Matches)(lua_State*)>
+struct LuaCandidate {
+    static bool matches(lua_State* L) { return Matches(L); }
+    static int call(lua_State* L) { return F(L); }
+};
+
+template <typename... Candidates>
+struct LuaOverloads {
+    static int call(lua_State* L)
+    {
+        int result = -1;
+        ((Candidates::matches(L) && (result = Candidates::call(L), true)) || ...);
+        if (result >= 0)
+            return result;
+        // nothing matched, let the first candidate report the argument error
+        return std::tuple_element_t<0, std::tuple<Candidates...>>::call(L);
+    }
+};
+
+template <auto F>
+constexpr lua_CFunction bind = LuaBind<F>::call;
+template <auto F>
+constexpr lua_CFunction bindOut = LuaBind<F, true>::call;
+template <auto Object, auto Method>
+constexpr lua_CFunction bindMethod = LuaBindMethod<Object, Method>::call;
+template <typename... Candidates>
+constexpr lua_CFunction overloads = LuaOverloads<Candidates...>::call;
+} // namespace
+
 //
 // VEC3
 //
@@ -124,9 +460,6 @@ int vec3_new(lua_State* L)
     LUA_GET_OUTPUT(Vec3);
 
     *outptr = Vec3(x, y, z);
-
-    luaL_getmetatable(L, "Vec3Meta");
-    lua_setmetatable(L, -2);
     return 1;
 }
 
@@ -160,51 +493,32 @@ int vec3_index_setter(lua_State* L)
     return 0;
 }
 
-int vec3_cross(lua_State* L)
-{
-    LUA_GET_INPUT(Vec3, a, 1);
-    LUA_GET_INPUT(Vec3, b, 2);
-    LUA_GET_OUTPUT(Vec3);
-
-    *outptr = glm::cross(*a, *b);
-
-    luaL_getmetatable(L, "Vec3Meta");
-    lua_setmetatable(L, -2);
-    return 1;
-}
-
-int vec3_dot(lua_State* L)
-{
-    LUA_GET_INPUT(Vec3, a, 1);
-    LUA_GET_INPUT(Vec3, b, 2);
-
-    Float dot = a->x * b->x + a->y * b->y + a->z * b->z;
+Vec3 vec3Cross(const Vec3& a, const Vec3& b) { return glm::cross(a, b); }
+Float vec3Dot(const Vec3& a, const Vec3& b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
 
-    lua_pushnumber(L, dot);
-    return 1;
-}
+// cross(a, b [, out]) -> vec3, dot(a, b) -> number
+constexpr lua_CFunction vec3_cross = bindOut<&vec3Cross>;
+constexpr lua_CFunction vec3_dot = bind<&vec3Dot>;
 
 typedef Vec3 (*BinaryFuncVec3Vec3)(const Vec3&, const Vec3&);
 int binaryFuncVec3Vec3(lua_State* L, BinaryFuncVec3Vec3 func)
 {
     Vec3 result;
+    const Vec3* v1 = LUA_TEST_INPUT(Vec3, 1);
+    const Vec3* v2 = LUA_TEST_INPUT(Vec3, 2);
 
-    if (luaL_testudata(L, 1, "Vec3Meta") && luaL_testudata(L, 2, "Vec3Meta")) {
-        LUA_GET_INPUT(Vec3, v1, 1);
-        LUA_GET_INPUT(Vec3, v2, 2);
+    if (v1 && v2) {
         result = func(*v1, *v2);
     }
 
-    else if (luaL_testudata(L, 1, "Vec3Meta") && lua_isnumber(L, 2)) {
-        LUA_GET_INPUT(Vec3, v, 1);
+    else if (v1 && lua_isnumber(L, 2)) {
         Float f = (Float)lua_tonumber(L, 2);
-        result = func(*v, Vec3(f, f, f));
+        result = func(*v1, Vec3(f, f, f));
     }
 
-    else if (lua_isnumber(L, 1) && luaL_testudata(L, 2, "Vec3Meta")) {
+    else if (lua_isnumber(L, 1) && v2) {
         Float f = (Float)lua_tonumber(L, 1);
-        LUA_GET_INPUT(Vec3, v, 2);
-        result = func(Vec3(f, f, f), *v);
+        result = func(Vec3(f, f, f), *v2);
 
     } else {
         return luaL_error(L, "Invalid operands for vec3 operations");
@@ -212,9 +526,6 @@ int binaryFuncVec3Vec3(lua_State* L, BinaryFuncVec3Vec3 func)
 
     LUA_GET_OUTPUT(Vec3);
     *outptr = result;
-
-    luaL_getmetatable(L, "Vec3Meta");
-    lua_setmetatable(L, -2);
     return 1;
 }
 
@@ -240,10 +551,10 @@ int quat_new(lua_State* L)
 {
     Quat result;
 
-    if (lua_isnumber(L, 1) && luaL_testudata(L, 2, "Vec3Meta")) {
+    const Vec3* axis = LUA_TEST_INPUT(Vec3, 2);
+    if (lua_isnumber(L, 1) && axis) {
         LUA_GET_FLOAT(y, 1);
-        LUA_GET_INPUT(Vec3, v, 2);
-        result = glm::angleAxis(y, glm::normalize(*v));
+        result = glm::angleAxis(y, glm::normalize(*axis));
 
     } else {
         LUA_GET_FLOAT(x, 1);
@@ -255,64 +566,42 @@ int quat_new(lua_State* L)
 
     LUA_GET_OUTPUT(Quat);
     *outptr = result;
-
-    luaL_getmetatable(L, "QuatMeta");
-    lua_setmetatable(L, -2);
     return 1;
 }
 
 int normalize(lua_State* L)
 {
-    if (luaL_testudata(L, 1, "Vec3Meta")) {
-        LUA_GET_INPUT(Vec3, v, 1);
+    if (const Vec3* v = LUA_TEST_INPUT(Vec3, 1)) {
         LUA_GET_OUTPUT(Vec3);
         *outptr = glm::normalize(*v);
-        luaL_getmetatable(L, "Vec3Meta");
 
-    } else if (luaL_testudata(L, 1, "QuatMeta")) {
-        LUA_GET_INPUT(Quat, q, 1);
+    } else if (const Quat* q = LUA_TEST_INPUT(Quat, 1)) {
         LUA_GET_OUTPUT(Quat);
         *outptr = glm::normalize(*q);
-        luaL_getmetatable(L, "QuatMeta");
 
     } else {
         return luaL_error(L, "Correct operands for normalize: quat, vec3");
     }
 
-    lua_setmetatable(L, -2);
     return 1;
 }
 
-int inverse(lua_State* L)
-{
-    LUA_GET_INPUT(Quat, v, 1);
-    LUA_GET_OUTPUT(Quat);
-    *outptr = glm::inverse(*v);
-
-    luaL_getmetatable(L, "QuatMeta");
-    lua_setmetatable(L, -2);
-    return 1;
-}
+Quat quatInverse(const Quat& q) { return glm::inverse(q); }
+constexpr lua_CFunction inverse = bind<&quatInverse>;
 
 int quat_mul(lua_State* L)
 {
     const char* errorMsg = "Correct operands: (quat = quat * quat) or (vec = quat * vec)";
 
-    if (luaL_testudata(L, 1, "QuatMeta")) {
-        LUA_GET_INPUT(Quat, q, 1);
-
-        if (luaL_testudata(L, 2, "Vec3Meta")) { // vec = quat * vec
-            LUA_GET_INPUT(Vec3, v, 2);
+    if (const Quat* q = LUA_TEST_INPUT(Quat, 1)) {
+        if (const Vec3* v = LUA_TEST_INPUT(Vec3, 2)) { // vec = quat * vec
             LUA_GET_OUTPUT(Vec3);
             *outptr = *q * *v;
-            luaL_getmetatable(L, "Vec3Meta");
             errorMsg = nullptr;
 
-        } else if (luaL_testudata(L, 2, "QuatMeta")) { // quat = quat * quat
-            LUA_GET_INPUT(Quat, q2, 2);
+        } else if (const Quat* q2 = LUA_TEST_INPUT(Quat, 2)) { // quat = quat * quat
             LUA_GET_OUTPUT(Quat);
             *outptr = glm::normalize(*q * *q2);
-            luaL_getmetatable(L, "QuatMeta");
             errorMsg = nullptr;
         }
     }
@@ -320,7 +609,6 @@ int quat_mul(lua_State* L)
     if (errorMsg)
         return luaL_error(L, errorMsg);
 
-    lua_setmetatable(L, -2);
     return 1;
 }
 
@@ -333,296 +621,2938 @@ int quat_tostring(lua_State* L)
 }
 
 //
-// SPLINE
+// ARRAYS
+//
+// Payload is stored inline right after the header (SoA for Vec3Array).
+// Slices are header-only userdata that point into the parent payload and
+// keep the parent alive through their user value. Read-only arrays are views
+// of shared memory (SHARED BLOBS); their slices are read-only too.
 //
 
-Spline spline;
+struct FloatArray {
+    int size;
+    bool readOnly;
+    Float* data;
+};
+
+struct Vec3Array {
+    int size;
+    bool readOnly;
+    Float* x;
+    Float* y;
+    Float* z;
+
+    Vec3 get(int i) const { return Vec3(x[i], y[i], z[i]); }
+    void set(int i, const Vec3& v) { x[i] = v.x, y[i] = v.y, z[i] = v.z; }
+};
 
-int roadSplineLength(lua_State* L)
+// largest size whose payload, 3 planes for Vec3Array, fits in an int of bytes
+constexpr int maxArraySize = INT_MAX / (3 * sizeof(Float));
+
+// size argument of FloatArray(n) and Vec3Array(n), checked before it is narrowed
+int checkArraySize(lua_State* L, int index)
 {
-    lua_pushnumber(L, spline.GetLength());
-    return 1;
+    const lua_Integer size = luaL_checkinteger(L, index);
+    luaL_argcheck(L, size >= 0 && size <= maxArraySize, index, "invalid size");
+    return (int)size;
 }
 
-int roadSplineNumSegments(lua_State* L)
+FloatArray* newFloatArray(lua_State* L, int size)
 {
-    lua_pushnumber(L, spline.GetNumSegments());
-    return 1;
+    if (size < 0 || size > maxArraySize)
+        luaL_error(L, "invalid array size %d", size);
+    FloatArray* arr = (FloatArray*)newUdata(L, sizeof(FloatArray) + size * sizeof(Float), FloatArrayMetaUpvalue);
+    arr->size = size;
+    arr->readOnly = false;
+    arr->data = (Float*)(arr + 1);
+    std::fill_n(arr->data, size, Float(0));
+    return arr;
 }
 
-int roadSplineDistanceToKey(lua_State* L)
+Vec3Array* newVec3Array(lua_State* L, int size)
 {
-    LUA_GET_FLOAT(distance, 1);
-    lua_pushnumber(L, spline.DistanceToKey(distance));
-    return 1;
+    if (size < 0 || size > maxArraySize)
+        luaL_error(L, "invalid array size %d", size);
+    Vec3Array* arr = (Vec3Array*)newUdata(L, sizeof(Vec3Array) + 3 * size * sizeof(Float), Vec3ArrayMetaUpvalue);
+    arr->size = size;
+    arr->readOnly = false;
+    arr->x = (Float*)(arr + 1);
+    arr->y = arr->x + size;
+    arr->z = arr->y + size;
+    std::fill_n(arr->x, 3 * size, Float(0));
+    return arr;
 }
 
-int roadSplineKeyToDistance(lua_State* L)
+template <typename Array>
+Array* checkWritable(lua_State* L, Array* arr)
 {
-    LUA_GET_FLOAT(key, 1);
-    lua_pushnumber(L, spline.KeyToDistance(key));
-    return 1;
+    if (arr->readOnly)
+        luaL_error(L, "array is read-only");
+    return arr;
 }
 
-int roadSplinePositionAtKey(lua_State* L)
+// optional output array at index, created when absent
+FloatArray* optFloatArrayOutput(lua_State* L, int index, int size)
 {
-    LUA_GET_FLOAT(key, 1);
-    LUA_GET_OUTPUT(Vec3);
+    if (lua_isnoneornil(L, index)) {
+        lua_settop(L, index - 1);
+        return newFloatArray(L, size);
+    }
 
-    *outptr = spline.GetInterpAtKey(key).getPos();
+    LUA_GET_INPUT(FloatArray, out, index);
+    checkWritable(L, out);
+    if (out->size != size)
+        luaL_error(L, "FloatArray size mismatch: %d, expected %d", out->size, size);
+    lua_settop(L, index);
+    return out;
+}
 
-    luaL_getmetatable(L, "Vec3Meta");
-    lua_setmetatable(L, -2);
+// checked as lua_Integer, an index past INT_MAX must not wrap into range
+int checkArrayIndex(lua_State* L, int index, int size)
+{
+    const lua_Integer i = luaL_checkinteger(L, index);
+    if (i < 1 || i > size)
+        luaL_error(L, "index out of range");
+    return (int)i - 1;
+}
+
+void checkSliceRange(lua_State* L, int size, int& first, int& count)
+{
+    const lua_Integer f = luaL_checkinteger(L, 2);
+    if (f < 1 || f > (lua_Integer)size + 1)
+        luaL_error(L, "slice out of range");
+    const lua_Integer n = luaL_optinteger(L, 3, size - f + 1);
+    if (n < 0 || n > size - f + 1)
+        luaL_error(L, "slice out of range");
+    first = (int)f - 1;
+    count = (int)n;
+}
+
+// FloatArray(n) or FloatArray({...})
+int floatArray_new(lua_State* L)
+{
+    if (lua_istable(L, 1)) {
+        const int size = (int)luaL_len(L, 1);
+        FloatArray* arr = newFloatArray(L, size);
+        for (int i = 0; i < size; ++i) {
+            lua_rawgeti(L, 1, i + 1);
+            arr->data[i] = (Float)lua_tonumber(L, -1);
+            lua_pop(L, 1);
+        }
+        return 1;
+    }
+
+    newFloatArray(L, checkArraySize(L, 1));
     return 1;
 }
 
-int roadSplineKeyClosestToPosition(lua_State* L)
+int floatArray_len(lua_State* L)
 {
-    LUA_GET_INPUT(Vec3, v, 1);
-    lua_pushnumber(L, spline.GetKeyClosestToPosition(*v));
+    LUA_GET_INPUT(FloatArray, arr, 1);
+    lua_pushinteger(L, arr->size);
     return 1;
 }
 
-int roadSplinePositionAndRotationAtKey(lua_State* L)
+int floatArray_get(lua_State* L)
 {
-    float f;
-    lua_pushnumber(L, f);
-    // in float, out (vec3, quat)
-    LUA_GET_OUTPUT(Vec3);
+    LUA_GET_INPUT(FloatArray, arr, 1);
+    lua_pushnumber(L, arr->data[checkArrayIndex(L, 2, arr->size)]);
+    return 1;
+}
 
-    luaL_getmetatable(L, "Vec3Meta");
-    lua_setmetatable(L, -2);
+int floatArray_set(lua_State* L)
+{
+    LUA_GET_INPUT(FloatArray, arr, 1);
+    checkWritable(L, arr);
+    const int i = checkArrayIndex(L, 2, arr->size);
+    arr->data[i] = (Float)luaL_checknumber(L, 3);
+    return 0;
+}
+
+int floatArray_fill(lua_State* L)
+{
+    LUA_GET_INPUT(FloatArray, arr, 1);
+    checkWritable(L, arr);
+    std::fill_n(arr->data, arr->size, (Float)luaL_checknumber(L, 2));
+    lua_settop(L, 1);
     return 1;
 }
 
-//
-// Arr2d
-//
+// slice(first [, count]) -> view sharing the parent storage
+int floatArray_slice(lua_State* L)
+{
+    LUA_GET_INPUT(FloatArray, arr, 1);
+    int first, count;
+    checkSliceRange(L, arr->size, first, count);
 
-struct Arr2d {
-    int width;
-    int height;
-    float* data;
-    float& get(int x, int y)
-    {
-        return data[y * width + x];
-    }
-};
+    FloatArray* view = (FloatArray*)newUdata(L, sizeof(FloatArray), FloatArrayMetaUpvalue, 1);
+    view->size = count;
+    view->readOnly = arr->readOnly;
+    view->data = arr->data + first;
 
-// --------------------- Lua bindings ---------------------
+    lua_pushvalue(L, 1);
+    lua_setiuservalue(L, -2, 1);
+    return 1;
+}
 
-int l_Arr2d_new(lua_State* L)
+// toTable([t]) -> fills t (or a new table) with the values
+int floatArray_toTable(lua_State* L)
 {
-    luaL_checktype(L, 1, LUA_TTABLE);
-
-    int height = luaL_len(L, 1);
-    lua_rawgeti(L, 1, 1);
-    int width = luaL_len(L, -1);
-    lua_pop(L, 1);
+    LUA_GET_INPUT(FloatArray, arr, 1);
+    if (lua_istable(L, 2))
+        lua_settop(L, 2);
+    else
+        lua_createtable(L, arr->size, 0);
+
+    for (int i = 0; i < arr->size; ++i) {
+        lua_pushnumber(L, arr->data[i]);
+        lua_rawseti(L, -2, i + 1);
+    }
+    return 1;
+}
 
-    Arr2d* arr = (Arr2d*)lua_newuserdata(L, sizeof(Arr2d));
-    arr->width = width;
-    arr->height = height;
-    arr->data = new float[width * height];
+int floatArray_tostring(lua_State* L)
+{
+    LUA_GET_INPUT(FloatArray, arr, 1);
+    lua_pushfstring(L, "FloatArray(%d)", arr->size);
+    return 1;
+}
 
-    // Fill data
-    for (int y = 0; y < height; ++y) {
-        lua_rawgeti(L, 1, y + 1);
-        for (int x = 0; x < width; ++x) {
-            lua_rawgeti(L, -1, x + 1);
-            arr->data[y * width + x] = (float)lua_tonumber(L, -1);
+// Vec3Array(n) or Vec3Array({vec3, ...})
+int vec3Array_new(lua_State* L)
+{
+    if (lua_istable(L, 1)) {
+        const int size = (int)luaL_len(L, 1);
+        Vec3Array* arr = newVec3Array(L, size);
+        for (int i = 0; i < size; ++i) {
+            lua_rawgeti(L, 1, i + 1);
+            LUA_GET_INPUT(Vec3, v, -1);
+            arr->set(i, *v);
             lua_pop(L, 1);
         }
-        lua_pop(L, 1);
+        return 1;
     }
 
-    // Set metatable
-    luaL_getmetatable(L, "Arr2d");
-    lua_setmetatable(L, -2);
+    newVec3Array(L, checkArraySize(L, 1));
     return 1;
 }
 
-// GC
-int l_Arr2d_gc(lua_State* L)
+int vec3Array_len(lua_State* L)
 {
-    Arr2d* arr = (Arr2d*)lua_touserdata(L, 1);
-    delete[] arr->data;
-    arr->data = nullptr;
-    return 0;
+    LUA_GET_INPUT(Vec3Array, arr, 1);
+    lua_pushinteger(L, arr->size);
+    return 1;
 }
 
-// get(x, y)
-int l_Arr2d_get(lua_State* L)
+int vec3Array_get(lua_State* L)
 {
-    Arr2d* arr = (Arr2d*)luaL_checkudata(L, 1, "Arr2d");
-    int x = luaL_checkinteger(L, 2) - 1;
-    int y = luaL_checkinteger(L, 3) - 1;
-    if (x < 0 || y < 0 || x >= arr->width || y >= arr->height)
-        return luaL_error(L, "index out of range");
-    lua_pushnumber(L, arr->get(x, y));
+    LUA_GET_INPUT(Vec3Array, arr, 1);
+    const int i = checkArrayIndex(L, 2, arr->size);
+    LUA_GET_OUTPUT(Vec3);
+    *outptr = arr->get(i);
     return 1;
 }
 
-int l_Arr2d_set(lua_State* L)
+int vec3Array_set(lua_State* L)
 {
-    Arr2d* arr = (Arr2d*)luaL_checkudata(L, 1, "Arr2d");
-    int x = luaL_checkinteger(L, 2) - 1;
-    int y = luaL_checkinteger(L, 3) - 1;
-    float v = (float)luaL_checknumber(L, 4);
-    if (x < 0 || y < 0 || x >= arr->width || y >= arr->height)
-        return luaL_error(L, "index out of range");
-    arr->get(x, y) = v;
+    LUA_GET_INPUT(Vec3Array, arr, 1);
+    checkWritable(L, arr);
+    const int i = checkArrayIndex(L, 2, arr->size);
+    LUA_GET_INPUT(Vec3, v, 3);
+    arr->set(i, *v);
     return 0;
 }
 
-// getRow(y)
-int l_Arr2d_getRow(lua_State* L)
+int vec3Array_slice(lua_State* L)
 {
-    Arr2d* arr = (Arr2d*)luaL_checkudata(L, 1, "Arr2d");
-    int rowIndex = luaL_checkinteger(L, 2) - 1;
-    if (rowIndex < 0 || rowIndex >= arr->height)
-        return luaL_error(L, "row out of range");
-
-    lua_createtable(L, arr->width, 0);
-    for (int x = 0; x < arr->width; ++x) {
-        lua_pushnumber(L, arr->get(x, rowIndex));
-        lua_rawseti(L, -2, x + 1);
-    }
+    LUA_GET_INPUT(Vec3Array, arr, 1);
+    int first, count;
+    checkSliceRange(L, arr->size, first, count);
+
+    Vec3Array* view = (Vec3Array*)newUdata(L, sizeof(Vec3Array), Vec3ArrayMetaUpvalue, 1);
+    view->size = count;
+    view->readOnly = arr->readOnly;
+    view->x = arr->x + first;
+    view->y = arr->y + first;
+    view->z = arr->z + first;
+
+    lua_pushvalue(L, 1);
+    lua_setiuservalue(L, -2, 1);
     return 1;
 }
 
-int l_Arr2d_getBinarySearchByCol(lua_State* L)
+int vec3Array_tostring(lua_State* L)
 {
+    LUA_GET_INPUT(Vec3Array, arr, 1);
+    lua_pushfstring(L, "Vec3Array(%d)", arr->size);
+    return 1;
+}
 
-    Arr2d* array2d = (Arr2d*)luaL_checkudata(L, 1, "Arr2d");
-    int colIndex = luaL_checkinteger(L, 2) - 1;
-
-    if (array2d->width <= 0 || array2d->height <= 0)
-        return luaL_error(L, "Arr2d empty");
-
-    if (colIndex < 0 || colIndex >= array2d->width)
-        return luaL_error(L, "col out of range");
+// Bulk ops work in place on self and return self, so chains don't allocate.
+// The loops run over plain SoA float arrays and are left to the compiler to vectorize.
 
-    Float targetValue = luaL_checknumber(L, 3);
+// self op (Vec3Array | vec3 | number); func is inlined into both loops
+template <typename Func>
+int bulkFuncVec3Array(lua_State* L, Func func)
+{
+    LUA_GET_INPUT(Vec3Array, a, 1);
+    checkWritable(L, a);
+    const int n = a->size;
+    Float *ax = a->x, *ay = a->y, *az = a->z;
+
+    if (const Vec3Array* b = LUA_TEST_INPUT(Vec3Array, 2)) {
+        if (b->size != n)
+            return luaL_error(L, "Vec3Array size mismatch: %d vs %d", n, b->size);
+        const Float *bx = b->x, *by = b->y, *bz = b->z;
+        for (int i = 0; i < n; ++i)
+            func(ax[i], ay[i], az[i], bx[i], by[i], bz[i]);
 
-    auto strideWidth = array2d->width;
-    auto initialOffset = colIndex;
-    auto arr = array2d->data;
+    } else {
+        Vec3 v;
+        if (const Vec3* pv = LUA_TEST_INPUT(Vec3, 2))
+            v = *pv;
+        else if (lua_isnumber(L, 2))
+            v = Vec3((Float)lua_tonumber(L, 2));
+        else
+            return luaL_error(L, "Invalid operands for Vec3Array operations");
+
+        for (int i = 0; i < n; ++i)
+            func(ax[i], ay[i], az[i], v.x, v.y, v.z);
+    }
 
-    std::tuple<int, int> range = BinarySearchFindBounds<Float>(
-        array2d->data, array2d->height, array2d->width, colIndex, targetValue);
+    lua_settop(L, 1);
+    return 1;
+}
 
-    // printf("%d, %d", std::get<0>(a), std::get<1>(a));
+// clang-format off
+int vec3Array_add(lua_State* L) { return bulkFuncVec3Array(L, [](Float& ax, Float& ay, Float& az, Float bx, Float by, Float bz) { ax += bx, ay += by, az += bz; }); }
+int vec3Array_sub(lua_State* L) { return bulkFuncVec3Array(L, [](Float& ax, Float& ay, Float& az, Float bx, Float by, Float bz) { ax -= bx, ay -= by, az -= bz; }); }
+int vec3Array_mul(lua_State* L) { return bulkFuncVec3Array(L, [](Float& ax, Float& ay, Float& az, Float bx, Float by, Float bz) { ax *= bx, ay *= by, az *= bz; }); }
+// clang-format on
 
-    const int index0 = std::get<0>(range), index1 = std::get<1>(range);
+// scale(number | FloatArray)
+int vec3Array_scale(lua_State* L)
+{
+    LUA_GET_INPUT(Vec3Array, a, 1);
+    checkWritable(L, a);
+    const int n = a->size;
+    Float *ax = a->x, *ay = a->y, *az = a->z;
+
+    if (const FloatArray* scales = LUA_TEST_INPUT(FloatArray, 2)) {
+        if (scales->size != n)
+            return luaL_error(L, "FloatArray size mismatch: %d, expected %d", scales->size, n);
+        const Float* sd = scales->data;
+        for (int i = 0; i < n; ++i)
+            ax[i] *= sd[i], ay[i] *= sd[i], az[i] *= sd[i];
 
-#define GET_ARR(x) arr[x * strideWidth + initialOffset]
-    Float param = normalizeRangeClamped(GET_ARR(index0), GET_ARR(index1), targetValue);
-    lua_createtable(L, array2d->width, 0);
-    for (int x = 0; x < array2d->width; ++x) {
-        lua_pushnumber(L, glm::mix(array2d->get(x, index0), array2d->get(x, index1), param));
-        lua_rawseti(L, -2, x + 1);
+    } else {
+        LUA_GET_FLOAT(s, 2);
+        for (int i = 0; i < n; ++i)
+            ax[i] *= s, ay[i] *= s, az[i] *= s;
     }
 
-#undef GET_ARR
+    lua_settop(L, 1);
     return 1;
 }
 
+// dot(Vec3Array | vec3 [, out FloatArray]) -> FloatArray
+int vec3Array_dot(lua_State* L)
+{
+    LUA_GET_INPUT(Vec3Array, a, 1);
+    const int n = a->size;
+    const Float *ax = a->x, *ay = a->y, *az = a->z;
+
+    if (const Vec3Array* barr = LUA_TEST_INPUT(Vec3Array, 2)) {
+        if (barr->size != n)
+            return luaL_error(L, "Vec3Array size mismatch: %d vs %d", n, barr->size);
+        const Float *bx = barr->x, *by = barr->y, *bz = barr->z;
+        Float* out = optFloatArrayOutput(L, 3, n)->data;
+        for (int i = 0; i < n; ++i)
+            out[i] = ax[i] * bx[i] + ay[i] * by[i] + az[i] * bz[i];
+
+    } else {
+        LUA_GET_INPUT(Vec3, v, 2);
+        const Vec3 b = *v;
+        Float* out = optFloatArrayOutput(L, 3, n)->data;
+        for (int i = 0; i < n; ++i)
+            out[i] = ax[i] * b.x + ay[i] * b.y + az[i] * b.z;
+    }
+    return 1;
+}
+
+// length([out FloatArray]) -> FloatArray
+int vec3Array_length(lua_State* L)
+{
+    LUA_GET_INPUT(Vec3Array, a, 1);
+    const int n = a->size;
+    const Float *ax = a->x, *ay = a->y, *az = a->z;
+
+    Float* out = optFloatArrayOutput(L, 2, n)->data;
+    for (int i = 0; i < n; ++i)
+        out[i] = std::sqrt(ax[i] * ax[i] + ay[i] * ay[i] + az[i] * az[i]);
+    return 1;
+}
+
+// zero-length elements are left as zero
+int vec3Array_normalize(lua_State* L)
+{
+    LUA_GET_INPUT(Vec3Array, a, 1);
+    checkWritable(L, a);
+    const int n = a->size;
+    Float *ax = a->x, *ay = a->y, *az = a->z;
+
+    for (int i = 0; i < n; ++i) {
+        const Float len2 = ax[i] * ax[i] + ay[i] * ay[i] + az[i] * az[i];
+        const Float inv = len2 > Float(0) ? Float(1) / std::sqrt(len2) : Float(0);
+        ax[i] *= inv, ay[i] *= inv, az[i] *= inv;
+    }
+
+    lua_settop(L, 1);
+    return 1;
+}
+
+// lerp(Vec3Array, t)
+int vec3Array_lerp(lua_State* L)
+{
+    LUA_GET_INPUT(Vec3Array, a, 1);
+    checkWritable(L, a);
+    LUA_GET_INPUT(Vec3Array, b, 2);
+    LUA_GET_FLOAT(t, 3);
+    const int n = a->size;
+    if (b->size != n)
+        return luaL_error(L, "Vec3Array size mismatch: %d vs %d", n, b->size);
+
+    Float *ax = a->x, *ay = a->y, *az = a->z;
+    const Float *bx = b->x, *by = b->y, *bz = b->z;
+    for (int i = 0; i < n; ++i) {
+        ax[i] += (bx[i] - ax[i]) * t;
+        ay[i] += (by[i] - ay[i]) * t;
+        az[i] += (bz[i] - az[i]) * t;
+    }
+
+    lua_settop(L, 1);
+    return 1;
+}
+
+// out = rot * v + pos over SoA arrays, out may alias v;
+// v' = v + w * t + cross(q, t), t = 2 * cross(q, v)
+void transformSoA(const Quat& rot, const Vec3& pos, const Float* vxs, const Float* vys, const Float* vzs,
+    Float* oxs, Float* oys, Float* ozs, int n)
+{
+    const Float qx = rot.x, qy = rot.y, qz = rot.z, qw = rot.w;
+    for (int i = 0; i < n; ++i) {
+        const Float vx = vxs[i], vy = vys[i], vz = vzs[i];
+        const Float tx = Float(2) * (qy * vz - qz * vy);
+        const Float ty = Float(2) * (qz * vx - qx * vz);
+        const Float tz = Float(2) * (qx * vy - qy * vx);
+        oxs[i] = vx + qw * tx + (qy * tz - qz * ty) + pos.x;
+        oys[i] = vy + qw * ty + (qz * tx - qx * tz) + pos.y;
+        ozs[i] = vz + qw * tz + (qx * ty - qy * tx) + pos.z;
+    }
+}
+
+// transform(quat | Transform)
+int vec3Array_transform(lua_State* L)
+{
+    LUA_GET_INPUT(Vec3Array, a, 1);
+    checkWritable(L, a);
+    Transform t;
+    if (const Transform* pt = LUA_TEST_INPUT(Transform, 2))
+        t = *pt;
+    else {
+        LUA_GET_INPUT(Quat, q, 2);
+        t.rot = *q;
+    }
+    transformSoA(t.rot, t.pos, a->x, a->y, a->z, a->x, a->y, a->z, a->size);
+
+    lua_settop(L, 1);
+    return 1;
+}
+
+//
+// SHARED BLOBS
+//
+// A LuaBlob (lua_blob.h) is seen as a lightuserdata global. Its arrays come
+// out as header-only read-only views into the blob, which outlives the state.
+//
+
+const LuaBlob* checkBlob(lua_State* L, int index)
+{
+    const void* p = lua_touserdata(L, index);
+    bool isBlob = false;
+    if (lua_islightuserdata(L, index)) {
+        isBlob = lua_rawgetp(L, LUA_REGISTRYINDEX, p) == LUA_TBOOLEAN; // set by setLuaBlob
+        lua_pop(L, 1);
+    }
+    if (!isBlob)
+        luaL_typeerror(L, index, "LuaBlob");
+    return (const LuaBlob*)p;
+}
+
+// (blob, name) arguments
+Float* checkBlobArray(lua_State* L, LuaBlob::Kind kind, int& size)
+{
+    const LuaBlob* blob = checkBlob(L, 1);
+    const char* name = luaL_checkstring(L, 2);
+    const Float* data = blob->find(name, kind, size);
+    if (!data)
+        luaL_error(L, "no %s array '%s' in the blob", kind == LuaBlob::Kind::Floats ? "float" : "vec3", name);
+    return const_cast<Float*>(data); // guarded by readOnly
+}
+
+// blobFloats(blob, name) -> read-only FloatArray
+int blobFloats(lua_State* L)
+{
+    int size;
+    Float* data = checkBlobArray(L, LuaBlob::Kind::Floats, size);
+    FloatArray* view = (FloatArray*)newUdata(L, sizeof(FloatArray), FloatArrayMetaUpvalue);
+    view->size = size;
+    view->readOnly = true;
+    view->data = data;
+    return 1;
+}
+
+// blobVec3s(blob, name) -> read-only Vec3Array
+int blobVec3s(lua_State* L)
+{
+    int size;
+    Float* data = checkBlobArray(L, LuaBlob::Kind::Vec3s, size);
+    Vec3Array* view = (Vec3Array*)newUdata(L, sizeof(Vec3Array), Vec3ArrayMetaUpvalue);
+    view->size = size;
+    view->readOnly = true;
+    view->x = data;
+    view->y = data + size;
+    view->z = data + 2 * size;
+    return 1;
+}
+
+// blobString(blob, i) -> string
+int blobString(lua_State* L)
+{
+    const LuaBlob* blob = checkBlob(L, 1);
+    size_t length;
+    const char* str = blob->getString(checkArrayIndex(L, 2, blob->getNumStrings()), length);
+    lua_pushlstring(L, str, length);
+    return 1;
+}
+
+int blobNumStrings(lua_State* L)
+{
+    lua_pushinteger(L, checkBlob(L, 1)->getNumStrings());
+    return 1;
+}
+
+//
+// BATCH
+//
+// Batch bindings take N inputs as a Lua array or a typed buffer (FloatArray,
+// Vec3Array) and write N outputs into a caller-supplied table or buffer.
+// A missing output is created with the same kind as the input.
+//
+
+// slot 0 and 1: table inputs, slot 2: table output
+std::vector<Float>& batchScratch(int slot)
+{
+    thread_local std::vector<Float> scratch[3];
+    return scratch[slot];
+}
+
+bool isBatchArg(lua_State* L, int index)
+{
+    return lua_istable(L, index) || LUA_TEST_INPUT(FloatArray, index) || LUA_TEST_INPUT(Vec3Array, index);
+}
+
+const Float* getFloatBatch(lua_State* L, int index, int& size, int scratchSlot = 0)
+{
+    if (const FloatArray* arr = LUA_TEST_INPUT(FloatArray, index)) {
+        size = arr->size;
+        return arr->data;
+    }
+
+    luaL_checktype(L, index, LUA_TTABLE);
+    size = (int)lua_rawlen(L, index);
+    std::vector<Float>& scratch = batchScratch(scratchSlot);
+    scratch.resize(size);
+    for (int i = 0; i < size; ++i) {
+        lua_rawgeti(L, index, i + 1);
+        scratch[i] = (Float)lua_tonumber(L, -1);
+        lua_pop(L, 1);
+    }
+    return scratch.data();
+}
+
+// leaves the output at index; the returned buffer is flushed by endFloatBatchOutput
+Float* beginFloatBatchOutput(lua_State* L, int index, int size, bool makeTable)
+{
+    if (lua_isnoneornil(L, index)) {
+        lua_settop(L, index - 1);
+        if (!makeTable)
+            return newFloatArray(L, size)->data;
+        lua_createtable(L, size, 0);
+
+    } else if (FloatArray* arr = LUA_TEST_INPUT(FloatArray, index)) {
+        checkWritable(L, arr);
+        if (arr->size != size)
+            luaL_error(L, "FloatArray size mismatch: %d, expected %d", arr->size, size);
+        lua_settop(L, index);
+        return arr->data;
+
+    } else {
+        luaL_checktype(L, index, LUA_TTABLE);
+        lua_settop(L, index);
+    }
+
+    std::vector<Float>& scratch = batchScratch(2);
+    scratch.resize(size);
+    return scratch.data();
+}
+
+void endFloatBatchOutput(lua_State* L, int index, const Float* values, int size)
+{
+    if (!lua_istable(L, index))
+        return;
+
+    for (int i = 0; i < size; ++i) {
+        lua_pushnumber(L, values[i]);
+        lua_rawseti(L, index, i + 1);
+    }
+}
+
+struct Vec3BatchInput {
+    const Vec3Array* arr = nullptr;
+    int tableIndex = 0;
+    int size = 0;
+};
+
+Vec3BatchInput getVec3Batch(lua_State* L, int index)
+{
+    Vec3BatchInput in;
+    if ((in.arr = LUA_TEST_INPUT(Vec3Array, index))) {
+        in.size = in.arr->size;
+    } else {
+        luaL_checktype(L, index, LUA_TTABLE);
+        in.tableIndex = index;
+        in.size = (int)lua_rawlen(L, index);
+    }
+    return in;
+}
+
+Vec3 getVec3BatchElement(lua_State* L, const Vec3BatchInput& in, int i)
+{
+    if (in.arr)
+        return in.arr->get(i);
+
+    lua_rawgeti(L, in.tableIndex, i + 1);
+    LUA_GET_INPUT(Vec3, v, -1);
+    const Vec3 result = *v;
+    lua_pop(L, 1);
+    return result;
+}
+
+// returns the Vec3Array output, or nullptr when the output is a table left at index
+Vec3Array* beginVec3BatchOutput(lua_State* L, int index, int size, bool makeTable)
+{
+    if (lua_isnoneornil(L, index)) {
+        lua_settop(L, index - 1);
+        if (!makeTable)
+            return newVec3Array(L, size);
+        lua_createtable(L, size, 0);
+        return nullptr;
+    }
+
+    if (Vec3Array* arr = LUA_TEST_INPUT(Vec3Array, index)) {
+        checkWritable(L, arr);
+        if (arr->size != size)
+            luaL_error(L, "Vec3Array size mismatch: %d, expected %d", arr->size, size);
+        lua_settop(L, index);
+        return arr;
+    }
+
+    luaL_checktype(L, index, LUA_TTABLE);
+    lua_settop(L, index);
+    return nullptr;
+}
+
+// table outputs reuse the vec3 already stored in the slot, if any
+void setVec3BatchElement(lua_State* L, Vec3Array* out, int index, int i, const Vec3& v)
+{
+    if (out) {
+        out->set(i, v);
+        return;
+    }
+
+    lua_rawgeti(L, index, i + 1);
+    if (Vec3* slot = LUA_TEST_INPUT(Vec3, -1)) {
+        *slot = v;
+        lua_pop(L, 1);
+        return;
+    }
+
+    lua_pop(L, 1);
+    LUA_GET_OUTPUT(Vec3);
+    *outptr = v;
+    lua_rawseti(L, index, i + 1);
+}
+
+template <typename Func>
+int batchFloatToFloat(lua_State* L, Func func)
+{
+    int size;
+    const bool makeTable = lua_istable(L, 1);
+    const Float* in = getFloatBatch(L, 1, size);
+    Float* out = beginFloatBatchOutput(L, 2, size, makeTable);
+    for (int i = 0; i < size; ++i)
+        out[i] = func(in[i]);
+    endFloatBatchOutput(L, 2, out, size);
+    return 1;
+}
+
+//
+// TRANSFORM
+//
+// Position and rotation in one userdata (Transform, cpp_math.h). Each
+// operation is one call without Vec3/Quat intermediates, and products are
+// not renormalized the way quat * quat is.
+//
+
+constexpr int transformMethodsUpvalue = MetaUpvalueCount + 1;
+
+// transform([pos [, rot]]) -> identity when no arguments
+int transform_new(lua_State* L)
+{
+    Transform t;
+    if (!lua_isnoneornil(L, 1)) {
+        LUA_GET_INPUT(Vec3, pos, 1);
+        t.pos = *pos;
+    }
+    if (!lua_isnoneornil(L, 2)) {
+        LUA_GET_INPUT(Quat, rot, 2);
+        t.rot = *rot;
+    }
+    LUA_GET_OUTPUT(Transform);
+    *outptr = t;
+    return 1;
+}
+
+// t.pos and t.rot are copies; other keys come from the method table upvalue
+int transform_index(lua_State* L)
+{
+    LUA_GET_INPUT(Transform, t, 1);
+    const char* key = lua_tostring(L, 2);
+    if (key && strcmp(key, "pos") == 0) {
+        LUA_GET_OUTPUT(Vec3);
+        *outptr = t->pos;
+    } else if (key && strcmp(key, "rot") == 0) {
+        LUA_GET_OUTPUT(Quat);
+        *outptr = t->rot;
+    } else {
+        lua_pushvalue(L, 2);
+        lua_rawget(L, lua_upvalueindex(transformMethodsUpvalue));
+    }
+    return 1;
+}
+
+int transform_newindex(lua_State* L)
+{
+    LUA_GET_INPUT(Transform, t, 1);
+    const char* key = luaL_checkstring(L, 2);
+    if (strcmp(key, "pos") == 0) {
+        LUA_GET_INPUT(Vec3, pos, 3);
+        t->pos = *pos;
+    } else if (strcmp(key, "rot") == 0) {
+        LUA_GET_INPUT(Quat, rot, 3);
+        t->rot = glm::normalize(*rot);
+    } else {
+        return luaL_error(L, "Transform has no field '%s'", key);
+    }
+    return 0;
+}
+
+int transform_tostring(lua_State* L)
+{
+    LUA_GET_INPUT(Transform, t, 1);
+    lua_pushfstring(L, "transform(vec3(%f, %f, %f), quat(%f, %f, %f, %f))", (double)t->pos.x, (double)t->pos.y,
+        (double)t->pos.z, (double)t->rot.x, (double)t->rot.y, (double)t->rot.z, (double)t->rot.w);
+    return 1;
+}
+
+Vec3 transformPoint(const Transform& t, const Vec3& p) { return t.transformPoint(p); }
+Vec3 inverseTransformPoint(const Transform& t, const Vec3& p) { return t.inverseTransformPoint(p); }
+Transform transformCompose(const Transform& a, const Transform& b) { return a * b; }
+Transform transformInverse(const Transform& t) { return t.inverse(); }
+
+// positions mix linearly, rotations take the short way (nlerp)
+Transform transformLerp(const Transform& a, const Transform& b, Float s)
+{
+    const Quat rot = glm::dot(a.rot, b.rot) < Float(0) ? -b.rot : b.rot;
+    return { a.pos + (b.pos - a.pos) * s, glm::normalize(a.rot * (Float(1) - s) + rot * s) };
+}
+
+Transform transformSlerp(const Transform& a, const Transform& b, Float s)
+{
+    return { a.pos + (b.pos - a.pos) * s, glm::slerp(a.rot, b.rot, s) };
+}
+
+// methods take an optional out userdata after the inputs, like the other bindings:
+// t:transformPoint(p [, out]), t:compose(b [, out]), t:lerp(b, s [, out]) ...
+constexpr lua_CFunction transform_transformPoint = bindOut<&transformPoint>;
+constexpr lua_CFunction transform_inverseTransformPoint = bindOut<&inverseTransformPoint>;
+constexpr lua_CFunction transform_compose = bindOut<&transformCompose>;
+constexpr lua_CFunction transform_inverse = bindOut<&transformInverse>;
+constexpr lua_CFunction transform_lerp = bindOut<&transformLerp>;
+constexpr lua_CFunction transform_slerp = bindOut<&transformSlerp>;
+
+// a * b composes, t * v transforms a point
+constexpr lua_CFunction transform_mul = overloads<LuaBind<&transformCompose>, LuaBind<&transformPoint>>;
+
+// t:transformPoints(Vec3Array | {vec3, ...} [, out]) -> out, same kind as the input;
+// out may be the input
+template <bool inverse>
+int transform_transformPoints(lua_State* L)
+{
+    LUA_GET_INPUT(Transform, pt, 1);
+    const Transform t = inverse ? pt->inverse() : *pt;
+    const Vec3BatchInput in = getVec3Batch(L, 2);
+    Vec3Array* out = beginVec3BatchOutput(L, 3, in.size, in.tableIndex != 0);
+
+    if (in.arr && out) {
+        transformSoA(t.rot, t.pos, in.arr->x, in.arr->y, in.arr->z, out->x, out->y, out->z, in.size);
+    } else {
+        for (int i = 0; i < in.size; ++i)
+            setVec3BatchElement(L, out, 3, i, t.transformPoint(getVec3BatchElement(L, in, i)));
+    }
+    return 1;
+}
+
+//
+// KERNELS
+//
+// kernel("out = normalize(a - b) * s") compiles an element-wise expression
+// once into a linear op list; k{ out = arr, a = arr, b = arr, s = 2 } runs it
+// over whole arrays. Names are bound per call to FloatArray/Vec3Array
+// (per element) or number/vec3 (uniform). Assigned names bound to an array
+// are written, unbound ones are temporaries. The arrays are processed in
+// chunks: every op is a plain loop over SoA registers, left to the compiler
+// to vectorize. All reads of a chunk happen before its writes, so an output
+// may be the very same array as an input; arrays that partially overlap one
+// that is written (slices at different offsets) are rejected. Fixed limits
+// keep the kernel a plain userdata.
+//
+
+constexpr int kernelMaxOps = 64;
+constexpr int kernelMaxVars = 16;
+constexpr int kernelMaxName = 32;
+constexpr int kernelChunk = 128;
+
+enum KernelOpCode : uint8_t {
+    KernelLoad, // dst = var a
+    KernelConst, // dst = value
+    KernelStore, // var a = reg b
+    KernelNeg,
+    KernelAdd,
+    KernelSub,
+    KernelMul,
+    KernelDiv,
+    KernelMin,
+    KernelMax,
+    KernelSqrt,
+    KernelAbs,
+    KernelNormalize,
+    KernelLength,
+    KernelDot,
+    KernelCross,
+    KernelLerp,
+    KernelVec3,
+    KernelX,
+    KernelY,
+    KernelZ,
+};
+
+struct KernelOp {
+    KernelOpCode code;
+    uint8_t dst, a, b, c;
+    Float value;
+};
+
+struct Kernel {
+    int numOps;
+    int numRegs;
+    int numVars;
+    KernelOp ops[kernelMaxOps];
+    char names[kernelMaxVars][kernelMaxName];
+};
+
+struct KernelFunction {
+    const char* name;
+    KernelOpCode code;
+    int numArgs;
+};
+
+const KernelFunction kernelFunctions[] = {
+    { "min", KernelMin, 2 }, { "max", KernelMax, 2 }, { "sqrt", KernelSqrt, 1 }, { "abs", KernelAbs, 1 },
+    { "normalize", KernelNormalize, 1 }, { "length", KernelLength, 1 }, { "dot", KernelDot, 2 },
+    { "cross", KernelCross, 2 }, { "lerp", KernelLerp, 3 }, { "vec3", KernelVec3, 3 }
+};
+
+// Recursive descent straight into ops; plain data only, errors longjmp out.
+// Loads go first and stores last, whatever their place in the source.
+struct KernelCompiler {
+    lua_State* L;
+    const char* source;
+    const char* p;
+    Kernel& k;
+    KernelOp loads[kernelMaxVars], body[kernelMaxOps], stores[kernelMaxVars];
+    int numLoads = 0, numBody = 0, numStores = 0;
+    int current[kernelMaxVars]; // register holding each name, -1 before first use
+
+    KernelCompiler(lua_State* ls, const char* src, Kernel& kernel)
+        : L(ls)
+        , source(src)
+        , p(src)
+        , k(kernel)
+    {
+    }
+
+    void error(const char* message)
+    {
+        luaL_error(L, "kernel: %s at column %d", message, (int)(p - source) + 1);
+    }
+
+    void skipSpace()
+    {
+        while (isspace((unsigned char)*p))
+            ++p;
+    }
+
+    bool accept(char c)
+    {
+        skipSpace();
+        if (*p != c)
+            return false;
+        ++p;
+        return true;
+    }
+
+    void expect(char c)
+    {
+        if (!accept(c)) {
+            char message[] = "expected ' '";
+            message[10] = c;
+            error(message);
+        }
+    }
+
+    int identifier(char (&name)[kernelMaxName])
+    {
+        skipSpace();
+        const char* start = p;
+        if (!isalpha((unsigned char)*p) && *p != '_')
+            return 0;
+        while (isalnum((unsigned char)*p) || *p == '_')
+            ++p;
+        if (p - start >= kernelMaxName)
+            error("name too long");
+        const int length = std::min((int)(p - start), kernelMaxName - 1);
+        memcpy(name, start, length);
+        name[length] = 0;
+        return length;
+    }
+
+    void reserveOp()
+    {
+        if (numLoads + numBody + numStores == kernelMaxOps)
+            error("expression too long");
+    }
+
+    int emit(KernelOpCode code, int a = 0, int b = 0, int c = 0, Float value = 0)
+    {
+        reserveOp();
+        const int dst = k.numRegs++;
+        body[numBody++] = { code, (uint8_t)dst, (uint8_t)a, (uint8_t)b, (uint8_t)c, value };
+        return dst;
+    }
+
+    int var(const char* name)
+    {
+        for (int v = 0; v < k.numVars; ++v)
+            if (strcmp(k.names[v], name) == 0)
+                return v;
+        if (k.numVars == kernelMaxVars)
+            error("too many names");
+        strcpy(k.names[k.numVars], name);
+        current[k.numVars] = -1;
+        return k.numVars++;
+    }
+
+    int primary()
+    {
+        skipSpace();
+        if (accept('(')) {
+            const int r = expr();
+            expect(')');
+            return r;
+        }
+
+        if (isdigit((unsigned char)*p) || *p == '.') {
+            float value;
+            auto [next, ec] = std::from_chars(p, p + strlen(p), value);
+            if (ec != std::errc())
+                error("bad number");
+            p = next;
+            return emit(KernelConst, 0, 0, 0, (Float)value);
+        }
+
+        char name[kernelMaxName];
+        if (!identifier(name))
+            error("expected an expression");
+
+        if (accept('(')) {
+            const KernelFunction* f = nullptr;
+            for (const KernelFunction& candidate : kernelFunctions)
+                if (strcmp(candidate.name, name) == 0)
+                    f = &candidate;
+            if (!f)
+                error("unknown function");
+            int args[3] = {};
+            for (int i = 0; i < f->numArgs; ++i) {
+                if (i)
+                    expect(',');
+                args[i] = expr();
+            }
+            expect(')');
+            return emit(f->code, args[0], args[1], args[2]);
+        }
+
+        const int v = var(name);
+        if (current[v] < 0) {
+            reserveOp();
+            current[v] = k.numRegs++;
+            loads[numLoads++] = { KernelLoad, (uint8_t)current[v], (uint8_t)v, 0, 0, 0 };
+        }
+        return current[v];
+    }
+
+    // primary { .x | .y | .z }
+    int postfix()
+    {
+        int r = primary();
+        while (accept('.')) {
+            skipSpace();
+            const char c = *p++;
+            if (c != 'x' && c != 'y' && c != 'z')
+                error("expected x, y or z");
+            r = emit(KernelOpCode(KernelX + (c - 'x')), r);
+        }
+        return r;
+    }
+
+    int unary()
+    {
+        if (accept('-'))
+            return emit(KernelNeg, unary());
+        return postfix();
+    }
+
+    int term()
+    {
+        int r = unary();
+        for (;;) {
+            if (accept('*'))
+                r = emit(KernelMul, r, unary());
+            else if (accept('/'))
+                r = emit(KernelDiv, r, unary());
+            else
+                return r;
+        }
+    }
+
+    int expr()
+    {
+        int r = term();
+        for (;;) {
+            if (accept('+'))
+                r = emit(KernelAdd, r, term());
+            else if (accept('-'))
+                r = emit(KernelSub, r, term());
+            else
+                return r;
+        }
+    }
+
+    // name = expr { [;] name = expr }
+    void compile()
+    {
+        k.numOps = k.numRegs = k.numVars = 0;
+        p = source;
+        do {
+            char name[kernelMaxName];
+            if (!identifier(name))
+                error("expected an assignment");
+            expect('=');
+            const int r = expr();
+            const int v = var(name);
+            current[v] = r;
+
+            int s = 0; // a name assigned twice is stored once
+            while (s < numStores && stores[s].a != v)
+                ++s;
+            if (s == numStores) {
+                reserveOp();
+                ++numStores;
+            }
+            stores[s] = { KernelStore, 0, (uint8_t)v, (uint8_t)r, 0, 0 };
+            accept(';');
+            skipSpace();
+        } while (*p);
+
+        std::copy_n(loads, numLoads, k.ops);
+        std::copy_n(body, numBody, k.ops + numLoads);
+        std::copy_n(stores, numStores, k.ops + numLoads + numBody);
+        k.numOps = numLoads + numBody + numStores;
+    }
+};
+
+enum KernelVarKind : uint8_t {
+    KernelUnbound,
+    KernelFloats, // FloatArray
+    KernelVec3s, // Vec3Array
+    KernelNumber,
+    KernelVector, // vec3
+};
+
+struct KernelVar {
+    KernelVarKind kind;
+    int size;
+    Float* x;
+    Float* y;
+    Float* z;
+    Vec3 uniform;
+};
+
+// true if any planes of two bound arrays share memory without being the same plane
+bool kernelVarsOverlap(const KernelVar& a, const KernelVar& b, int size)
+{
+    const bool aArray = a.kind == KernelFloats || a.kind == KernelVec3s;
+    const bool bArray = b.kind == KernelFloats || b.kind == KernelVec3s;
+    if (!aArray || !bArray)
+        return false;
+
+    const Float* aPlanes[3] = { a.x, a.y, a.z };
+    const Float* bPlanes[3] = { b.x, b.y, b.z };
+    const size_t bytes = sizeof(Float) * size;
+    for (int i = 0; i < (a.kind == KernelVec3s ? 3 : 1); ++i)
+        for (int j = 0; j < (b.kind == KernelVec3s ? 3 : 1); ++j) {
+            const uintptr_t pa = (uintptr_t)aPlanes[i], pb = (uintptr_t)bPlanes[j];
+            if (pa != pb && pa < pb + bytes && pb < pa + bytes)
+                return true;
+        }
+    return false;
+}
+
+// kernel(source) -> Kernel
+int kernel_new(lua_State* L)
+{
+    const char* source = luaL_checkstring(L, 1);
+    Kernel* k = (Kernel*)newUdata(L, sizeof(Kernel), KernelMetaUpvalue);
+    KernelCompiler(L, source, *k).compile();
+    return 1;
+}
+
+// k{ name = value, ... }
+int kernel_call(lua_State* L)
+{
+    LUA_GET_INPUT(Kernel, k, 1);
+    luaL_checktype(L, 2, LUA_TTABLE);
+
+    // bind names; the arrays stay referenced by the table for the call
+    KernelVar vars[kernelMaxVars];
+    int size = -1;
+    for (int v = 0; v < k->numVars; ++v) {
+        KernelVar& var = vars[v];
+        var = { KernelUnbound, 0, nullptr, nullptr, nullptr, Vec3(0) };
+        lua_getfield(L, 2, k->names[v]);
+        if (FloatArray* arr = LUA_TEST_INPUT(FloatArray, -1)) {
+            var.kind = KernelFloats, var.size = arr->size, var.x = arr->data;
+        } else if (Vec3Array* arr = LUA_TEST_INPUT(Vec3Array, -1)) {
+            var.kind = KernelVec3s, var.size = arr->size, var.x = arr->x, var.y = arr->y, var.z = arr->z;
+        } else if (const Vec3* vec = LUA_TEST_INPUT(Vec3, -1)) {
+            var.kind = KernelVector, var.uniform = *vec;
+        } else if (lua_type(L, -1) == LUA_TNUMBER) {
+            var.kind = KernelNumber, var.uniform = Vec3((Float)lua_tonumber(L, -1));
+        } else if (!lua_isnil(L, -1)) {
+            return luaL_error(L, "kernel: '%s' must be a FloatArray, Vec3Array, number or vec3", k->names[v]);
+        }
+
+        if (var.kind == KernelFloats || var.kind == KernelVec3s) {
+            if (size >= 0 && var.size != size)
+                return luaL_error(L, "kernel: '%s' has %d elements, expected %d", k->names[v], var.size, size);
+            size = var.size;
+        }
+        lua_pop(L, 1);
+    }
+    if (size < 0)
+        return luaL_error(L, "kernel: no FloatArray or Vec3Array bound");
+
+    // register types: true for vec3
+    bool isVec[kernelMaxOps] = {};
+    for (int i = 0; i < k->numOps; ++i) {
+        const KernelOp& op = k->ops[i];
+        const bool a = isVec[op.a], b = isVec[op.b], c = isVec[op.c];
+        auto fail = [&](const char* expects) {
+            luaL_error(L, "kernel: op %d expects %s", i + 1, expects);
+        };
+
+        switch (op.code) {
+        case KernelLoad: {
+            const KernelVar& var = vars[op.a];
+            if (var.kind == KernelUnbound)
+                luaL_error(L, "kernel: '%s' is not bound", k->names[op.a]);
+            isVec[op.dst] = var.kind == KernelVec3s || var.kind == KernelVector;
+            break;
+        }
+        case KernelConst:
+            isVec[op.dst] = false;
+            break;
+        case KernelStore: {
+            KernelVar& var = vars[op.a];
+            if (var.kind == KernelUnbound)
+                break;
+            if (var.kind != (isVec[op.b] ? KernelVec3s : KernelFloats))
+                luaL_error(L, "kernel: '%s' must be a %s to be assigned", k->names[op.a], isVec[op.b] ? "Vec3Array" : "FloatArray");
+            lua_getfield(L, 2, k->names[op.a]);
+            if (isVec[op.b])
+                checkWritable(L, LUA_TEST_INPUT(Vec3Array, -1));
+            else
+                checkWritable(L, LUA_TEST_INPUT(FloatArray, -1));
+            lua_pop(L, 1);
+            break;
+        }
+        case KernelNeg:
+        case KernelSqrt:
+        case KernelAbs:
+            isVec[op.dst] = a;
+            break;
+        case KernelAdd:
+        case KernelSub:
+        case KernelMul:
+        case KernelDiv:
+        case KernelMin:
+        case KernelMax:
+            isVec[op.dst] = a || b;
+            break;
+        case KernelNormalize:
+            if (!a)
+                fail("normalize(vec3)");
+            isVec[op.dst] = true;
+            break;
+        case KernelLength:
+            if (!a)
+                fail("length(vec3)");
+            isVec[op.dst] = false;
+            break;
+        case KernelDot:
+        case KernelCross:
+            if (!a || !b)
+                fail(op.code == KernelDot ? "dot(vec3, vec3)" : "cross(vec3, vec3)");
+            isVec[op.dst] = op.code == KernelCross;
+            break;
+        case KernelLerp:
+            if (c)
+                fail("lerp(a, b, number)");
+            isVec[op.dst] = a || b;
+            break;
+        case KernelVec3:
+            if (a || b || c)
+                fail("vec3(number, number, number)");
+            isVec[op.dst] = true;
+            break;
+        case KernelX:
+        case KernelY:
+        case KernelZ:
+            if (!a)
+                fail("vec3.x|y|z");
+            isVec[op.dst] = false;
+            break;
+        }
+    }
+
+    // chunks store after they load, which only holds up when a written array
+    // is either the same array as another binding or disjoint from it
+    bool stored[kernelMaxVars] = {};
+    for (int i = 0; i < k->numOps; ++i)
+        if (k->ops[i].code == KernelStore)
+            stored[k->ops[i].a] = true;
+    for (int v = 0; v < k->numVars; ++v)
+        for (int w = 0; stored[v] && w < k->numVars; ++w)
+            if (w != v && kernelVarsOverlap(vars[v], vars[w], size))
+                return luaL_error(L, "kernel: '%s' partially overlaps '%s'", k->names[v], k->names[w]);
+
+    // three planes per register, a number uses the first
+    thread_local std::vector<Float> scratch;
+    scratch.resize((size_t)k->numRegs * 3 * kernelChunk);
+    Float* const regs = scratch.data();
+    auto out = [&](int r, int c) { return regs + (r * 3 + c) * kernelChunk; };
+    auto in = [&](int r, int c) -> const Float* { return regs + (r * 3 + (isVec[r] ? c : 0)) * kernelChunk; };
+
+    for (int first = 0; first < size; first += kernelChunk) {
+        const int m = std::min(kernelChunk, size - first);
+
+        for (int i = 0; i < k->numOps; ++i) {
+            const KernelOp& op = k->ops[i];
+            const int numComps = isVec[op.dst] ? 3 : 1;
+
+            auto unary = [&](auto f) {
+                for (int c = 0; c < numComps; ++c) {
+                    Float* o = out(op.dst, c);
+                    const Float* a = in(op.a, c);
+                    for (int j = 0; j < m; ++j)
+                        o[j] = f(a[j]);
+                }
+            };
+            auto binary = [&](auto f) {
+                for (int c = 0; c < numComps; ++c) {
+                    Float* o = out(op.dst, c);
+                    const Float *a = in(op.a, c), *b = in(op.b, c);
+                    for (int j = 0; j < m; ++j)
+                        o[j] = f(a[j], b[j]);
+                }
+            };
+
+            switch (op.code) {
+            case KernelLoad: {
+                const KernelVar& var = vars[op.a];
+                if (var.kind == KernelFloats) {
+                    std::copy_n(var.x + first, m, out(op.dst, 0));
+                } else if (var.kind == KernelVec3s) {
+                    std::copy_n(var.x + first, m, out(op.dst, 0));
+                    std::copy_n(var.y + first, m, out(op.dst, 1));
+                    std::copy_n(var.z + first, m, out(op.dst, 2));
+                } else {
+                    for (int c = 0; c < numComps; ++c)
+                        std::fill_n(out(op.dst, c), m, var.uniform[c]);
+                }
+                break;
+            }
+            case KernelConst:
+                std::fill_n(out(op.dst, 0), m, op.value);
+                break;
+            case KernelStore: {
+                const KernelVar& var = vars[op.a];
+                if (var.kind == KernelFloats) {
+                    std::copy_n(in(op.b, 0), m, var.x + first);
+                } else if (var.kind == KernelVec3s) {
+                    std::copy_n(in(op.b, 0), m, var.x + first);
+                    std::copy_n(in(op.b, 1), m, var.y + first);
+                    std::copy_n(in(op.b, 2), m, var.z + first);
+                }
+                break;
+            }
+            // clang-format off
+            case KernelNeg: unary([](Float a) { return -a; }); break;
+            case KernelSqrt: unary([](Float a) { return std::sqrt(a); }); break;
+            case KernelAbs: unary([](Float a) { return std::abs(a); }); break;
+            case KernelAdd: binary([](Float a, Float b) { return a + b; }); break;
+            case KernelSub: binary([](Float a, Float b) { return a - b; }); break;
+            case KernelMul: binary([](Float a, Float b) { return a * b; }); break;
+            case KernelDiv: binary([](Float a, Float b) { return a / b; }); break;
+            case KernelMin: binary([](Float a, Float b) { return std::min(a, b); }); break;
+            case KernelMax: binary([](Float a, Float b) { return std::max(a, b); }); break;
+            // clang-format on
+            case KernelNormalize:
+            case KernelLength:
+            case KernelDot: {
+                const Float *ax = in(op.a, 0), *ay = in(op.a, 1), *az = in(op.a, 2);
+                const int b = op.code == KernelDot ? op.b : op.a;
+                const Float *bx = in(b, 0), *by = in(b, 1), *bz = in(b, 2);
+                Float* o = out(op.dst, 0);
+                for (int j = 0; j < m; ++j)
+                    o[j] = ax[j] * bx[j] + ay[j] * by[j] + az[j] * bz[j];
+                if (op.code == KernelLength) {
+                    for (int j = 0; j < m; ++j)
+                        o[j] = std::sqrt(o[j]);
+                } else if (op.code == KernelNormalize) { // zero-length elements are left as zero
+                    Float *ox = o, *oy = out(op.dst, 1), *oz = out(op.dst, 2);
+                    for (int j = 0; j < m; ++j) {
+                        const Float inv = ox[j] > Float(0) ? Float(1) / std::sqrt(ox[j]) : Float(0);
+                        ox[j] = ax[j] * inv, oy[j] = ay[j] * inv, oz[j] = az[j] * inv;
+                    }
+                }
+                break;
+            }
+            case KernelCross: {
+                const Float *ax = in(op.a, 0), *ay = in(op.a, 1), *az = in(op.a, 2);
+                const Float *bx = in(op.b, 0), *by = in(op.b, 1), *bz = in(op.b, 2);
+                Float *ox = out(op.dst, 0), *oy = out(op.dst, 1), *oz = out(op.dst, 2);
+                for (int j = 0; j < m; ++j) {
+                    ox[j] = ay[j] * bz[j] - az[j] * by[j];
+                    oy[j] = az[j] * bx[j] - ax[j] * bz[j];
+                    oz[j] = ax[j] * by[j] - ay[j] * bx[j];
+                }
+                break;
+            }
+            case KernelLerp:
+                for (int c = 0; c < numComps; ++c) {
+                    Float* o = out(op.dst, c);
+                    const Float *a = in(op.a, c), *b = in(op.b, c), *t = in(op.c, 0);
+                    for (int j = 0; j < m; ++j)
+                        o[j] = a[j] + (b[j] - a[j]) * t[j];
+                }
+                break;
+            case KernelVec3:
+                std::copy_n(in(op.a, 0), m, out(op.dst, 0));
+                std::copy_n(in(op.b, 0), m, out(op.dst, 1));
+                std::copy_n(in(op.c, 0), m, out(op.dst, 2));
+                break;
+            case KernelX:
+            case KernelY:
+            case KernelZ:
+                std::copy_n(in(op.a, op.code - KernelX), m, out(op.dst, 0));
+                break;
+            }
+        }
+    }
+    return 0;
+}
+
+int kernel_tostring(lua_State* L)
+{
+    LUA_GET_INPUT(Kernel, k, 1);
+    lua_pushfstring(L, "Kernel(%d ops, %d names)", k->numOps, k->numVars);
+    return 1;
+}
+
+//
+// SPLINE
+//
+
+Spline spline;
+
+Vec3 splinePositionAtKey(Float key) { return spline.GetInterpAtKey(key).getPos(); }
+Float splineKeyClosestToPosition(const Vec3& pos) { return spline.GetKeyClosestToPosition(pos); }
+
+bool isBatchCall(lua_State* L) { return isBatchArg(L, 1); }
+
+int roadSplineDistanceToKeyBatch(lua_State* L)
+{
+    return batchFloatToFloat(L, [](Float distance) { return spline.DistanceToKey(distance); });
+}
+
+int roadSplineKeyToDistanceBatch(lua_State* L)
+{
+    return batchFloatToFloat(L, [](Float key) { return spline.KeyToDistance(key); });
+}
+
+int roadSplinePositionAtKeyBatch(lua_State* L)
+{
+    int size;
+    const bool makeTable = lua_istable(L, 1);
+    const Float* keys = getFloatBatch(L, 1, size);
+    Vec3Array* out = beginVec3BatchOutput(L, 2, size, makeTable);
+    for (int i = 0; i < size; ++i)
+        setVec3BatchElement(L, out, 2, i, splinePositionAtKey(keys[i]));
+    return 1;
+}
+
+int roadSplineKeyClosestToPositionBatch(lua_State* L)
+{
+    const Vec3BatchInput in = getVec3Batch(L, 1);
+    Float* out = beginFloatBatchOutput(L, 2, in.size, in.tableIndex != 0);
+    for (int i = 0; i < in.size; ++i)
+        out[i] = splineKeyClosestToPosition(getVec3BatchElement(L, in, i));
+    endFloatBatchOutput(L, 2, out, in.size);
+    return 1;
+}
+
+// clang-format off
+constexpr lua_CFunction roadSplineLength = bindMethod<&spline, &Spline::GetLength>;
+constexpr lua_CFunction roadSplineNumSegments = bindMethod<&spline, &Spline::GetNumSegments>;
+
+// roadSplineDistanceToKey(distance) -> key
+// roadSplineDistanceToKey(distances [, out]) -> out
+constexpr lua_CFunction roadSplineDistanceToKey = overloads<
+    LuaBindMethod<&spline, &Spline::DistanceToKey>,
+    LuaCandidate<roadSplineDistanceToKeyBatch, isBatchCall>>;
+
+// roadSplineKeyToDistance(key) -> distance
+// roadSplineKeyToDistance(keys [, out]) -> out
+constexpr lua_CFunction roadSplineKeyToDistance = overloads<
+    LuaBindMethod<&spline, &Spline::KeyToDistance>,
+    LuaCandidate<roadSplineKeyToDistanceBatch, isBatchCall>>;
+
+// roadSplinePositionAtKey(key [, out vec3]) -> vec3
+// roadSplinePositionAtKey(keys [, out]) -> out
+constexpr lua_CFunction roadSplinePositionAtKey = overloads<
+    LuaBind<&splinePositionAtKey, true>,
+    LuaCandidate<roadSplinePositionAtKeyBatch, isBatchCall>>;
+
+// roadSplineKeyClosestToPosition(vec3) -> key
+// roadSplineKeyClosestToPosition(positions [, out]) -> out
+constexpr lua_CFunction roadSplineKeyClosestToPosition = overloads<
+    LuaBind<&splineKeyClosestToPosition>,
+    LuaCandidate<roadSplineKeyClosestToPositionBatch, isBatchCall>>;
+// clang-format on
+
+// Per-state cache of spline segments in polynomial form, kept as an extra
+// upvalue of roadSplinePositionAndRotationAtKey. The camera rig and the car
+// placement ask for keys close to each other every frame, which mostly fall
+// in the same few segments; the spline never changes. Positions are always
+// evaluated exactly. The frame (normalize, cross products, roll trig,
+// quat_cast) is reused for keys within frameKeyTolerance of the last key
+// framed in the segment: on the road that is under 0.07 degrees.
+struct SplineFrameCache {
+    static constexpr int numSegments = 4; // direct-mapped by segment index
+    static constexpr Float frameKeyTolerance = Float(1e-4);
+
+    struct Entry {
+        int index = -1;
+        Spline::Segment segment;
+        Float frameKey = -1; // key of rot, -1 when none
+        Quat rot;
+    };
+
+    Entry entries[numSegments];
+
+    // same clamping as Spline::GetInterpAtKey, NaN reads as 0
+    void get(Float key, Vec3& pos, Quat& rot)
+    {
+        const Float numKeys = (Float)spline.GetNumSegments();
+        key = key >= 0 ? std::min(key, numKeys) : Float(0);
+        const int index = (int)key;
+
+        Entry& e = entries[index % numSegments];
+        if (e.index != index) {
+            e.index = index;
+            e.segment = spline.GetInterpAtKey(key).getSegment();
+            e.frameKey = -1;
+        }
+        if (e.frameKey < 0 || std::abs(key - e.frameKey) > frameKeyTolerance) {
+            e.frameKey = key;
+            e.rot = e.segment.getRotation(key - index);
+        }
+        pos = e.segment.getPos(key - index);
+        rot = e.rot;
+    }
+};
+
+constexpr int splineFrameCacheUpvalue = MetaUpvalueCount + 1;
+
+// roadSplinePositionAndRotationAtKey(key [, out vec3, out quat]) -> vec3, quat
+int roadSplinePositionAndRotationAtKey(lua_State* L)
+{
+    LUA_GET_FLOAT(key, 1);
+    auto* cache = (SplineFrameCache*)lua_touserdata(L, lua_upvalueindex(splineFrameCacheUpvalue));
+    Vec3 framePos;
+    Quat frameRot;
+    cache->get(key, framePos, frameRot);
+
+    Vec3* pos = LUA_TEST_INPUT(Vec3, 2);
+    Quat* rot = LUA_TEST_INPUT(Quat, 3);
+    if (pos && rot) {
+        *pos = framePos;
+        *rot = frameRot;
+        lua_settop(L, 3);
+        return 2;
+    }
+
+    lua_settop(L, 1);
+    *(Vec3*)newUdata(L, sizeof(Vec3), Vec3MetaUpvalue) = framePos;
+    *(Quat*)newUdata(L, sizeof(Quat), QuatMetaUpvalue) = frameRot;
+    return 2;
+}
+
+//
+// Arr2d
+//
+
+// The payload is stored inline right after the header, so an Arr2d is one
+// allocation and the GC accounts for its real size.
+struct Arr2d {
+    int width;
+    int height;
+    float* data; // -> inline payload
+    int numIndexes; // column indexes cached in the user value table
+    float& get(int x, int y)
+    {
+        return data[y * width + x];
+    }
+};
+
+// strided row or column of an Arr2d, keeps the parent alive via its user value
+struct Arr2dView {
+    Arr2d* parent;
+    float* data;
+    int size;
+    int stride;
+    int col; // column of a col view, -1 for a row view
+    float& get(int i) { return data[i * stride]; }
+};
+
+Arr2d* newArr2d(lua_State* L, int width, int height)
+{
+    Arr2d* arr = (Arr2d*)newUdata(L, sizeof(Arr2d) + sizeof(float) * width * height, Arr2dMetaUpvalue, 1);
+    arr->width = width;
+    arr->height = height;
+    arr->data = (float*)(arr + 1);
+    arr->numIndexes = 0;
+    return arr;
+}
+
+// Sorted permutation of one column plus a uniform bucket grid over the value
+// range, so lower bound lookups touch one small bucket instead of the whole
+// column. Stored inline in a userdata held by the Arr2d user value table.
+// NaN values have no order and are left out: their rows follow the sorted ones.
+struct Arr2dIndex {
+    int size; // rows with a value, the sorted part of rows
+
+    int numBuckets;
+    float minValue, invBucketWidth;
+    int* rows; // row indices sorted by value
+    float* values; // column values in sorted order
+    int* bucketStart; // numBuckets + 1 offsets into values
+
+    int bucketOf(float v) const
+    {
+        const float f = (v - minValue) * invBucketWidth;
+        return !(f > 0.0f) ? 0 : std::min((int)f, numBuckets - 1);
+    }
+
+    // first sorted position with values[pos] >= v
+    int lowerBound(float v) const
+    {
+        if (size == 0 || v <= values[0])
+            return 0;
+        if (v > values[size - 1])
+            return size;
+        const int b = bucketOf(v);
+        return int(std::lower_bound(values + bucketStart[b], values + bucketStart[b + 1], v) - values);
+    }
+};
+
+// returns the cached index of col, building it when build is set
+Arr2dIndex* getArr2dIndex(lua_State* L, int arrIndex, Arr2d* arr, int col, bool build)
+{
+    arrIndex = lua_absindex(L, arrIndex);
+    if (lua_getiuservalue(L, arrIndex, 1) != LUA_TTABLE) {
+        lua_pop(L, 1);
+        if (!build)
+            return nullptr;
+        lua_newtable(L);
+        lua_pushvalue(L, -1);
+        lua_setiuservalue(L, arrIndex, 1);
+    }
+
+    if (lua_rawgeti(L, -1, col + 1) == LUA_TUSERDATA) {
+        Arr2dIndex* index = (Arr2dIndex*)lua_touserdata(L, -1);
+        lua_pop(L, 2);
+        return index;
+    }
+    lua_pop(L, 1);
+    if (!build) {
+        lua_pop(L, 1);
+        return nullptr;
+    }
+
+    const int n = arr->height;
+    const int numBuckets = std::max(n, 1);
+    const size_t payload = sizeof(int) * n + sizeof(float) * n + sizeof(int) * (numBuckets + 1);
+    Arr2dIndex* index = (Arr2dIndex*)newUdata(L, sizeof(Arr2dIndex) + payload, Arr2dIndexMetaUpvalue);
+    index->numBuckets = numBuckets;
+    index->rows = (int*)(index + 1);
+    index->values = (float*)(index->rows + n);
+    index->bucketStart = (int*)(index->values + n);
+
+    int size = 0;
+    for (int y = 0; y < n; ++y)
+        if (!std::isnan(arr->get(col, y)))
+            index->rows[size++] = y;
+    for (int y = 0, i = size; y < n; ++y)
+        if (std::isnan(arr->get(col, y)))
+            index->rows[i++] = y;
+    index->size = size;
+
+    std::stable_sort(index->rows, index->rows + size, [&](int a, int b) { return arr->get(col, a) < arr->get(col, b); });
+    for (int i = 0; i < n; ++i)
+        index->values[i] = arr->get(col, index->rows[i]);
+
+    index->minValue = size ? index->values[0] : 0.0f;
+    const float range = size ? index->values[size - 1] - index->minValue : 0.0f;
+    index->invBucketWidth = range > 0.0f ? numBuckets / range : 0.0f;
+    for (int b = 0, i = 0; b <= numBuckets; ++b) {
+        while (i < size && index->bucketOf(index->values[i]) < b)
+            ++i;
+        index->bucketStart[b] = i;
+    }
+    index->bucketStart[numBuckets] = size;
+
+    lua_rawseti(L, -2, col + 1);
+    lua_pop(L, 1);
+    ++arr->numIndexes;
+    return index;
+}
+
+// drops the cached index of col after a write
+void invalidateArr2dIndex(lua_State* L, int arrIndex, Arr2d* arr, int col)
+{
+    if (!arr->numIndexes)
+        return;
+
+    lua_getiuservalue(L, arrIndex, 1);
+    if (lua_rawgeti(L, -1, col + 1) != LUA_TNIL) {
+        lua_pushnil(L);
+        lua_rawseti(L, -3, col + 1);
+        --arr->numIndexes;
+    }
+    lua_pop(L, 2);
+}
+
+// fills the table at index (or a new one) with n values
+template <typename Getter>
+void pushNumberRow(lua_State* L, int index, int n, Getter get)
+{
+    if (lua_istable(L, index))
+        lua_settop(L, index);
+    else
+        lua_createtable(L, n, 0);
+
+    for (int i = 0; i < n; ++i) {
+        lua_pushnumber(L, get(i));
+        lua_rawseti(L, -2, i + 1);
+    }
+}
+
+// --------------------- Lua bindings ---------------------
+
+int l_Arr2d_new(lua_State* L)
+{
+    luaL_checktype(L, 1, LUA_TTABLE);
+
+    int height = luaL_len(L, 1);
+    lua_rawgeti(L, 1, 1);
+    int width = luaL_len(L, -1);
+    lua_pop(L, 1);
+
+    Arr2d* arr = newArr2d(L, width, height);
+
+    // Fill data
+    for (int y = 0; y < height; ++y) {
+        lua_rawgeti(L, 1, y + 1);
+        for (int x = 0; x < width; ++x) {
+            lua_rawgeti(L, -1, x + 1);
+            arr->data[y * width + x] = (float)lua_tonumber(L, -1);
+            lua_pop(L, 1);
+        }
+        lua_pop(L, 1);
+    }
+    return 1;
+}
+
+// get(x, y)
+int l_Arr2d_get(lua_State* L)
+{
+    LUA_GET_INPUT(Arr2d, arr, 1);
+    int x = luaL_checkinteger(L, 2) - 1;
+    int y = luaL_checkinteger(L, 3) - 1;
+    if (x < 0 || y < 0 || x >= arr->width || y >= arr->height)
+        return luaL_error(L, "index out of range");
+    lua_pushnumber(L, arr->get(x, y));
+    return 1;
+}
+
+int l_Arr2d_set(lua_State* L)
+{
+    LUA_GET_INPUT(Arr2d, arr, 1);
+    int x = luaL_checkinteger(L, 2) - 1;
+    int y = luaL_checkinteger(L, 3) - 1;
+    float v = (float)luaL_checknumber(L, 4);
+    if (x < 0 || y < 0 || x >= arr->width || y >= arr->height)
+        return luaL_error(L, "index out of range");
+    arr->get(x, y) = v;
+    invalidateArr2dIndex(L, 1, arr, x);
+    return 0;
+}
+
+// getRow(y [, t]) -> t filled with the row values
+int l_Arr2d_getRow(lua_State* L)
+{
+    LUA_GET_INPUT(Arr2d, arr, 1);
+    int rowIndex = luaL_checkinteger(L, 2) - 1;
+    if (rowIndex < 0 || rowIndex >= arr->height)
+        return luaL_error(L, "row out of range");
+
+    pushNumberRow(L, 3, arr->width, [&](int x) { return arr->get(x, rowIndex); });
+    return 1;
+}
+
+int pushArr2dView(lua_State* L, Arr2d* parent, float* data, int size, int stride, int col)
+{
+    Arr2dView* view = (Arr2dView*)newUdata(L, sizeof(Arr2dView), Arr2dViewMetaUpvalue, 1);
+    view->parent = parent;
+    view->data = data;
+    view->size = size;
+    view->stride = stride;
+    view->col = col;
+
+    lua_pushvalue(L, 1);
+    lua_setiuservalue(L, -2, 1);
+    return 1;
+}
+
+// row(y) -> view
+int l_Arr2d_row(lua_State* L)
+{
+    LUA_GET_INPUT(Arr2d, arr, 1);
+    int rowIndex = luaL_checkinteger(L, 2) - 1;
+    if (rowIndex < 0 || rowIndex >= arr->height)
+        return luaL_error(L, "row out of range");
+    return pushArr2dView(L, arr, &arr->get(0, rowIndex), arr->width, 1, -1);
+}
+
+// col(x) -> view
+int l_Arr2d_col(lua_State* L)
+{
+    LUA_GET_INPUT(Arr2d, arr, 1);
+    int colIndex = luaL_checkinteger(L, 2) - 1;
+    if (colIndex < 0 || colIndex >= arr->width)
+        return luaL_error(L, "col out of range");
+    return pushArr2dView(L, arr, &arr->get(colIndex, 0), arr->height, arr->width, colIndex);
+}
+
+int l_Arr2d_size(lua_State* L)
+{
+    LUA_GET_INPUT(Arr2d, arr, 1);
+    lua_pushinteger(L, arr->width);
+    lua_pushinteger(L, arr->height);
+    return 2;
+}
+
+int l_Arr2dView_len(lua_State* L)
+{
+    LUA_GET_INPUT(Arr2dView, view, 1);
+    lua_pushinteger(L, view->size);
+    return 1;
+}
+
+int l_Arr2dView_get(lua_State* L)
+{
+    LUA_GET_INPUT(Arr2dView, view, 1);
+    lua_pushnumber(L, view->get(checkArrayIndex(L, 2, view->size)));
+    return 1;
+}
+
+int l_Arr2dView_set(lua_State* L)
+{
+    LUA_GET_INPUT(Arr2dView, view, 1);
+    const int i = checkArrayIndex(L, 2, view->size);
+    view->get(i) = (float)luaL_checknumber(L, 3);
+
+    if (view->parent->numIndexes) {
+        lua_getiuservalue(L, 1, 1);
+        invalidateArr2dIndex(L, lua_gettop(L), view->parent, view->col >= 0 ? view->col : i);
+    }
+    return 0;
+}
+
+// toTable([t]) -> t
+int l_Arr2dView_toTable(lua_State* L)
+{
+    LUA_GET_INPUT(Arr2dView, view, 1);
+    pushNumberRow(L, 2, view->size, [&](int i) { return view->get(i); });
+    return 1;
+}
+
+// binarySearchByCol(col, value [, t]) -> t filled with the lerped row
+// the column must be sorted unless it has an index (buildIndex)
+int l_Arr2d_getBinarySearchByCol(lua_State* L)
+{
+    LUA_GET_INPUT(Arr2d, array2d, 1);
+    int colIndex = luaL_checkinteger(L, 2) - 1;
+
+    if (array2d->width <= 0 || array2d->height <= 0)
+        return luaL_error(L, "Arr2d empty");
+
+    if (colIndex < 0 || colIndex >= array2d->width)
+        return luaL_error(L, "col out of range");
+
+    Float targetValue = luaL_checknumber(L, 3);
+    luaL_argcheck(L, !std::isnan(targetValue), 3, "NaN");
+
+    auto strideWidth = array2d->width;
+    auto initialOffset = colIndex;
+    auto arr = array2d->data;
+
+    std::tuple<int, int> range;
+    if (const Arr2dIndex* index = getArr2dIndex(L, 1, array2d, colIndex, false)) {
+        // indexed column, need not be sorted: neighbours in value order
+        if (index->size == 0)
+            return luaL_error(L, "Arr2d empty");
+        const int pos = index->lowerBound(targetValue);
+        const int last = index->size - 1;
+        range = { index->rows[std::clamp(pos - 1, 0, last)], index->rows[std::min(pos, last)] };
+        if (pos < index->size && index->values[pos] == targetValue)
+            range = { index->rows[pos], index->rows[pos] };
+    } else {
+        range = BinarySearchFindBounds<Float>(
+            array2d->data, array2d->height, array2d->width, colIndex, targetValue);
+    }
+
+    // printf("%d, %d", std::get<0>(a), std::get<1>(a));
+
+    const int index0 = std::get<0>(range), index1 = std::get<1>(range);
+
+#define GET_ARR(x) arr[x * strideWidth + initialOffset]
+    Float param = normalizeRangeClamped(GET_ARR(index0), GET_ARR(index1), targetValue);
+    pushNumberRow(L, 4, array2d->width, [&](int x) {
+        return glm::mix(array2d->get(x, index0), array2d->get(x, index1), param);
+    });
+
+#undef GET_ARR
+    return 1;
+}
+
+//
+// Arr2d files
+//
+// Binary: "AR2D", int32 width, int32 height, width * height native float32.
+// The payload is read straight into the userdata, no per-cell work.
+// CSV: comma separated rows, optional non-numeric header line. Parsed in two
+// streaming passes (count, then fill) so values go directly into the payload.
+// Loading can raise (bad data, out of memory), so the FILE* and the line
+// buffer are owned by userdata rather than the C stack.
+//
+
+const char arr2dFileMagic[4] = { 'A', 'R', '2', 'D' };
+constexpr size_t csvBufferSize = 1 << 16;
+
+// FILE* closed by __gc/__close; the metatable is an extra upvalue of Arr2d.load
+struct Arr2dFile {
+    FILE* file;
+};
+
+constexpr int arr2dFileMetaUpvalue = MetaUpvalueCount + 1;
+
+int arr2dFile_close(lua_State* L)
+{
+    auto* f = (Arr2dFile*)lua_touserdata(L, 1);
+    if (f->file)
+        fclose(f->file);
+    f->file = nullptr;
+    return 0;
+}
+
+class CsvLineReader {
+    FILE* file;
+    char* buf; // csvBufferSize bytes
+    size_t begin = 0, end = 0;
+    bool eof = false;
+
+public:
+    CsvLineReader(FILE* f, char* buffer)
+        : file(f)
+        , buf(buffer)
+    {
+    }
+
+    void rewind()
+    {
+        fseek(file, 0, SEEK_SET);
+        begin = end = 0;
+        eof = false;
+    }
+
+    // returns false at end of file; line is not null-terminated
+    bool next(const char*& line, size_t& len, bool& tooLong)
+    {
+        tooLong = false;
+        for (;;) {
+            if (const char* nl = (const char*)memchr(buf + begin, '\n', end - begin)) {
+                line = buf + begin;
+                len = nl - line;
+                begin += len + 1;
+                return true;
+            }
+
+            if (eof) {
+                if (begin == end)
+                    return false;
+                line = buf + begin;
+                len = end - begin;
+                begin = end;
+                return true;
+            }
+
+            if (begin == 0 && end == csvBufferSize) {
+                tooLong = true;
+                return false;
+            }
+
+            memmove(buf, buf + begin, end - begin);
+            end -= begin;
+            begin = 0;
+            end += fread(buf + end, 1, csvBufferSize - end, file);
+            eof = feof(file) || ferror(file);
+        }
+    }
+};
+
+bool isBlankLine(const char* line, size_t len)
+{
+    for (size_t i = 0; i < len; ++i)
+        if (!isspace((unsigned char)line[i]))
+            return false;
+    return true;
+}
+
+// parses up to maxValues comma separated floats, returns the number of values or -1
+int parseCsvLine(const char* line, size_t len, float* out, int maxValues)
+{
+    const char* p = line;
+    const char* const last = line + len;
+    int count = 0;
+
+    for (;;) {
+        while (p < last && (*p == ' ' || *p == '\t'))
+            ++p;
+        if (p < last && *p == '+')
+            ++p;
+
+        float value;
+        auto [next, ec] = std::from_chars(p, last, value);
+        if (ec != std::errc())
+            return -1;
+        if (count < maxValues)
+            out[count] = value;
+        ++count;
+
+        p = next;
+        while (p < last && (*p == ' ' || *p == '\t' || *p == '\r'))
+            ++p;
+        if (p == last)
+            return count;
+        if (*p++ != ',')
+            return -1;
+    }
+}
+
+// pushes the Arr2d or returns an error message
+const char* loadArr2dCsv(lua_State* L, FILE* file)
+{
+    static thread_local char error[128];
+    CsvLineReader reader(file, (char*)lua_newuserdatauv(L, csvBufferSize, 0));
+    const char* line;
+    size_t len;
+    bool tooLong;
+
+    // pass 1: dimensions
+    int width = 0, height = 0;
+    bool skipHeader = false;
+    while (reader.next(line, len, tooLong)) {
+        if (isBlankLine(line, len))
+            continue;
+        if (height == 0 && width == 0) {
+            const int n = parseCsvLine(line, len, nullptr, 0);
+            if (n < 0 && !skipHeader) {
+                skipHeader = true;
+                continue;
+            }
+            if (n <= 0)
+                break;
+            width = n;
+        }
+        ++height;
+    }
+    if (tooLong || height == 0) {
+        lua_pop(L, 1);
+        return tooLong ? "Arr2d.load: line too long" : "Arr2d.load: no numeric data";
+    }
+
+    // pass 2: fill
+    Arr2d* arr = newArr2d(L, width, height);
+    reader.rewind();
+    int y = 0;
+    bool headerSkipped = !skipHeader;
+    while (y < height && reader.next(line, len, tooLong)) {
+        if (isBlankLine(line, len))
+            continue;
+        if (!headerSkipped) {
+            headerSkipped = true;
+            continue;
+        }
+
+        const int n = parseCsvLine(line, len, &arr->get(0, y), width);
+        if (n != width) {
+            lua_pop(L, 2);
+            snprintf(error, sizeof(error), "Arr2d.load: bad row %d (%d values, expected %d)", y + 1, n, width);
+            return error;
+        }
+        ++y;
+    }
+    lua_remove(L, -2); // the line buffer
+    return nullptr;
+}
+
+const char* loadArr2dBinary(lua_State* L, FILE* file)
+{
+    int32_t dims[2];
+    if (fread(dims, sizeof(dims), 1, file) != 1 || dims[0] < 0 || dims[1] < 0)
+        return "Arr2d.load: truncated header";
+
+    // bound the size by the file before allocating, a corrupt header must not
+    // ask for gigabytes or overflow the int element indices
+    const size_t count = (size_t)dims[0] * dims[1];
+    const long dataStart = ftell(file);
+    if (dataStart < 0 || fseek(file, 0, SEEK_END) != 0)
+        return "Arr2d.load: can't seek";
+    const long fileEnd = ftell(file);
+    if (fileEnd < 0 || fseek(file, dataStart, SEEK_SET) != 0)
+        return "Arr2d.load: can't seek";
+    if (count > INT_MAX || count > (size_t)(fileEnd - dataStart) / sizeof(float))
+        return "Arr2d.load: size exceeds the file";
+
+    Arr2d* arr = newArr2d(L, dims[0], dims[1]);
+    if (fread(arr->data, sizeof(float), count, file) != count) {
+        lua_pop(L, 1);
+        return "Arr2d.load: truncated data";
+    }
+    return nullptr;
+}
+
+// Arr2d.load(path) -> Arr2d, format detected by the binary magic
+int l_Arr2d_load(lua_State* L)
+{
+    const char* path = luaL_checkstring(L, 1);
+    lua_settop(L, 1);
+    Arr2dFile* owner = (Arr2dFile*)lua_newuserdatauv(L, sizeof(Arr2dFile), 0);
+    owner->file = nullptr;
+    lua_pushvalue(L, lua_upvalueindex(arr2dFileMetaUpvalue));
+    lua_setmetatable(L, -2);
+
+    FILE* file = owner->file = fopen(path, "rb");
+    if (!file)
+        return luaL_error(L, "Arr2d.load: can't open %s", path);
+
+    char magic[sizeof(arr2dFileMagic)];
+    const bool isBinary = fread(magic, sizeof(magic), 1, file) == 1
+        && memcmp(magic, arr2dFileMagic, sizeof(magic)) == 0;
+    if (!isBinary)
+        fseek(file, 0, SEEK_SET);
+
+    const char* error = isBinary ? loadArr2dBinary(L, file) : loadArr2dCsv(L, file);
+    fclose(file);
+    owner->file = nullptr;
+
+    if (error)
+        return luaL_error(L, "%s (%s)", error, path);
+    return 1;
+}
+
+// save(path) writes the binary format
+int l_Arr2d_save(lua_State* L)
+{
+    LUA_GET_INPUT(Arr2d, arr, 1);
+    const char* path = luaL_checkstring(L, 2);
+    FILE* file = fopen(path, "wb");
+    if (!file)
+        return luaL_error(L, "Arr2d:save: can't open %s", path);
+
+    const int32_t dims[2] = { arr->width, arr->height };
+    const size_t count = (size_t)arr->width * arr->height;
+    const bool ok = fwrite(arr2dFileMagic, sizeof(arr2dFileMagic), 1, file) == 1
+        && fwrite(dims, sizeof(dims), 1, file) == 1
+        && fwrite(arr->data, sizeof(float), count, file) == count;
+    fclose(file);
+
+    if (!ok)
+        return luaL_error(L, "Arr2d:save: write failed %s", path);
+    return 0;
+}
+
+// Arr2d({...}) through the __call of the Arr2d table
+int l_Arr2d_call(lua_State* L)
+{
+    lua_remove(L, 1);
+    return l_Arr2d_new(L);
+}
+
 //
-// BOT
+// Arr2d grid
+//
+// Values sampled over two sorted axes, e.g. torque(rpm, throttle).
+// Axes and values are stored inline. Evenly spaced axes are detected at
+// construction and looked up in O(1), others by binary search.
+//
+
+struct GridAxis {
+    float* values;
+    int size;
+    bool uniform;
+    float origin, invStep;
+
+    void init()
+    {
+        uniform = size > 1;
+        origin = values[0];
+        if (size < 2)
+            return;
+
+        const float step = (values[size - 1] - values[0]) / (size - 1);
+        invStep = 1.0f / step;
+        const float tolerance = 1e-5f * std::abs(values[size - 1] - values[0]);
+        for (int i = 1; i < size - 1 && uniform; ++i)
+            uniform = std::abs(values[i] - (origin + i * step)) <= tolerance;
+    }
+
+    // cell index i (sample between i and i + 1) and lerp param, clamped to the
+    // axis; NaN clamps to the first sample, the lookups below never see it
+    void find(float v, int& i, float& t) const
+    {
+        if (size < 2 || !(v > values[0])) {
+            i = 0, t = 0.0f;
+            return;
+        }
+        if (v >= values[size - 1]) {
+            i = size - 2, t = 1.0f;
+            return;
+        }
+
+        if (uniform) {
+            const float f = (v - origin) * invStep;
+            i = std::min((int)f, size - 2);
+            t = f - (float)i;
+        } else {
+            i = int(std::upper_bound(values, values + size, v) - values) - 1;
+            t = (v - values[i]) / (values[i + 1] - values[i]);
+        }
+    }
+};
+
+struct Arr2dGrid {
+    GridAxis x, y;
+    float* values; // y.size rows of x.size values
+
+    float at(int ix, int iy) const { return values[iy * x.size + ix]; }
+
+    float sample(float vx, float vy) const
+    {
+        int ix, iy;
+        float tx, ty;
+        x.find(vx, ix, tx);
+        y.find(vy, iy, ty);
+        const int ix1 = std::min(ix + 1, x.size - 1), iy1 = std::min(iy + 1, y.size - 1);
+
+        const float v0 = at(ix, iy) + (at(ix1, iy) - at(ix, iy)) * tx;
+        const float v1 = at(ix, iy1) + (at(ix1, iy1) - at(ix, iy1)) * tx;
+        return v0 + (v1 - v0) * ty;
+    }
+};
+
+Arr2dGrid* newArr2dGrid(lua_State* L, int nx, int ny)
+{
+    const size_t numFloats = (size_t)nx + ny + (size_t)nx * ny;
+    Arr2dGrid* grid = (Arr2dGrid*)newUdata(L, sizeof(Arr2dGrid) + sizeof(float) * numFloats, Arr2dGridMetaUpvalue);
+    grid->x.values = (float*)(grid + 1);
+    grid->x.size = nx;
+    grid->y.values = grid->x.values + nx;
+    grid->y.size = ny;
+    grid->values = grid->y.values + ny;
+    return grid;
+}
+
+void checkSortedAxis(lua_State* L, const GridAxis& axis, const char* name)
+{
+    if (axis.size < 1)
+        luaL_error(L, "Arr2d.grid: %s axis is empty", name);
+    for (int i = 1; i < axis.size; ++i)
+        if (!(axis.values[i] > axis.values[i - 1]))
+            luaL_error(L, "Arr2d.grid: %s axis must be strictly increasing", name);
+}
+
+// Arr2d.grid(xs, ys, values Arr2d | {{...}}) or Arr2d.grid(arr) with the axes
+// taken from the first row (x) and first column (y) of arr
+int l_Arr2d_grid(lua_State* L)
+{
+    Arr2dGrid* grid;
+
+    if (const Arr2d* src = LUA_TEST_INPUT(Arr2d, 1)) {
+        if (src->width < 2 || src->height < 2)
+            return luaL_error(L, "Arr2d.grid: need at least 2x2 with axes in the first row and column");
+
+        const int nx = src->width - 1, ny = src->height - 1;
+        grid = newArr2dGrid(L, nx, ny);
+        std::copy_n(src->data + 1, nx, grid->x.values);
+        for (int iy = 0; iy < ny; ++iy) {
+            grid->y.values[iy] = src->data[(iy + 1) * src->width];
+            std::copy_n(src->data + (iy + 1) * src->width + 1, nx, grid->values + iy * nx);
+        }
+
+    } else {
+        int nx, ny;
+        const Float* xs = getFloatBatch(L, 1, nx, 0);
+        const Float* ys = getFloatBatch(L, 2, ny, 1);
+        grid = newArr2dGrid(L, nx, ny);
+        std::copy_n(xs, nx, grid->x.values);
+        std::copy_n(ys, ny, grid->y.values);
+
+        if (const Arr2d* values = LUA_TEST_INPUT(Arr2d, 3)) {
+            if (values->width != nx || values->height != ny)
+                return luaL_error(L, "Arr2d.grid: values are %dx%d, expected %dx%d", values->width, values->height, nx, ny);
+            std::copy_n(values->data, nx * ny, grid->values);
+
+        } else {
+            luaL_checktype(L, 3, LUA_TTABLE);
+            if ((int)lua_rawlen(L, 3) != ny)
+                return luaL_error(L, "Arr2d.grid: expected %d rows", ny);
+            for (int iy = 0; iy < ny; ++iy) {
+                lua_rawgeti(L, 3, iy + 1);
+                if (!lua_istable(L, -1) || (int)lua_rawlen(L, -1) != nx)
+                    return luaL_error(L, "Arr2d.grid: row %d must have %d values", iy + 1, nx);
+                for (int ix = 0; ix < nx; ++ix) {
+                    lua_rawgeti(L, -1, ix + 1);
+                    grid->values[iy * nx + ix] = (float)lua_tonumber(L, -1);
+                    lua_pop(L, 1);
+                }
+                lua_pop(L, 1);
+            }
+        }
+    }
+
+    checkSortedAxis(L, grid->x, "x");
+    checkSortedAxis(L, grid->y, "y");
+    grid->x.init();
+    grid->y.init();
+    return 1;
+}
+
+// sample(x, y) -> bilinear value, clamped at the edges
+int l_Arr2dGrid_sample(lua_State* L)
+{
+    LUA_GET_INPUT(Arr2dGrid, grid, 1);
+    LUA_GET_FLOAT(x, 2);
+    LUA_GET_FLOAT(y, 3);
+    lua_pushnumber(L, grid->sample(x, y));
+    return 1;
+}
+
+// sampleMany(xs, ys [, out]) -> out, inputs/outputs as in the batch bindings
+int l_Arr2dGrid_sampleMany(lua_State* L)
+{
+    LUA_GET_INPUT(Arr2dGrid, grid, 1);
+    int nx, ny;
+    const bool makeTable = lua_istable(L, 2);
+    const Float* xs = getFloatBatch(L, 2, nx, 0);
+    const Float* ys = getFloatBatch(L, 3, ny, 1);
+    if (nx != ny)
+        return luaL_error(L, "sampleMany: %d x values, %d y values", nx, ny);
+
+    Float* out = beginFloatBatchOutput(L, 4, nx, makeTable);
+    for (int i = 0; i < nx; ++i)
+        out[i] = grid->sample(xs[i], ys[i]);
+    endFloatBatchOutput(L, 4, out, nx);
+    return 1;
+}
+
+// size() -> number of x, y samples
+int l_Arr2dGrid_size(lua_State* L)
+{
+    LUA_GET_INPUT(Arr2dGrid, grid, 1);
+    lua_pushinteger(L, grid->x.size);
+    lua_pushinteger(L, grid->y.size);
+    return 2;
+}
+
+//
+// Arr2d column index
 //
 
-void pushVec3(lua_State* L, const Vec3& v)
+int checkArr2dCol(lua_State* L, const Arr2d* arr, int index)
 {
-    Vec3* u = (Vec3*)lua_newuserdata(L, sizeof(Vec3));
-    *u = v;
-    luaL_getmetatable(L, "Vec3Meta");
-    lua_setmetatable(L, -2);
+    const int col = (int)luaL_checkinteger(L, index) - 1;
+    if (col < 0 || col >= arr->width)
+        luaL_error(L, "col out of range");
+    return col;
 }
 
-bool callLuaProcessVecs(lua_State* L, const Vec3& a, const Vec3& b, float& out1, float& out2)
+// buildIndex(col) builds (or keeps) the sorted index of col
+int l_Arr2d_buildIndex(lua_State* L)
 {
-    lua_getglobal(L, "processVecs"); // push function
+    LUA_GET_INPUT(Arr2d, arr, 1);
+    getArr2dIndex(L, 1, arr, checkArr2dCol(L, arr, 2), true);
+    lua_settop(L, 1);
+    return 1;
+}
 
-    if (!lua_isfunction(L, -1)) {
+// findRange(col, lo, hi [, t]) -> t of rows with lo <= value <= hi in value order, count
+int l_Arr2d_findRange(lua_State* L)
+{
+    LUA_GET_INPUT(Arr2d, arr, 1);
+    const int col = checkArr2dCol(L, arr, 2);
+    LUA_GET_FLOAT(lo, 3);
+    LUA_GET_FLOAT(hi, 4);
+    luaL_argcheck(L, !std::isnan(lo), 3, "NaN");
+    luaL_argcheck(L, !std::isnan(hi), 4, "NaN");
+    const Arr2dIndex* index = getArr2dIndex(L, 1, arr, col, true);
+
+    const int first = index->lowerBound(lo);
+    int last = first;
+    while (last < index->size && index->values[last] <= hi)
+        ++last;
+
+    const int count = last - first;
+    if (lua_istable(L, 5))
+        lua_settop(L, 5);
+    else
+        lua_createtable(L, count, 0);
+
+    for (int i = 0; i < count; ++i) {
+        lua_pushinteger(L, index->rows[first + i] + 1);
+        lua_rawseti(L, -2, i + 1);
+    }
+    for (int i = count + 1; lua_rawgeti(L, -1, i) != LUA_TNIL; ++i) { // trim a reused table
         lua_pop(L, 1);
+        lua_pushnil(L);
+        lua_rawseti(L, -2, i);
+    }
+    lua_pop(L, 1);
+    lua_pushinteger(L, count);
+    return 2;
+}
+
+// nearest(col, value) -> row, value of the closest entry
+int l_Arr2d_nearest(lua_State* L)
+{
+    LUA_GET_INPUT(Arr2d, arr, 1);
+    const int col = checkArr2dCol(L, arr, 2);
+    LUA_GET_FLOAT(target, 3);
+    luaL_argcheck(L, !std::isnan(target), 3, "NaN");
+    const Arr2dIndex* index = getArr2dIndex(L, 1, arr, col, true);
+    if (index->size == 0)
+        return luaL_error(L, "Arr2d empty");
+
+    int pos = std::min(index->lowerBound(target), index->size - 1);
+    if (pos > 0 && std::abs(index->values[pos - 1] - target) <= std::abs(index->values[pos] - target))
+        --pos;
+
+    lua_pushinteger(L, index->rows[pos] + 1);
+    lua_pushnumber(L, index->values[pos]);
+    return 2;
+}
+
+//
+// CALL BRIDGE
+//
+// LuaFunction<R(Args...)> resolves a Lua function once into a registry ref and
+// calls it with typed arguments. Vec3/Quat arguments are written into userdata
+// preallocated per argument slot, so a call neither looks up a global nor
+// allocates. Scripts must copy such arguments if they keep them past the call.
+//
+
+template <typename Signature>
+class LuaFunction;
+
+template <typename R, typename... Args>
+class LuaFunction<R(Args...)> {
+    static constexpr int numArgs = sizeof...(Args);
+    static constexpr int numResults = std::is_void_v<R> ? 0 : LuaTraits<std::conditional_t<std::is_void_v<R>, int, R>>::numValues;
+
+    lua_State* L = nullptr;
+    int funcRef = LUA_NOREF;
+    int slotRefs[numArgs ? numArgs : 1];
+
+public:
+    using Result = std::conditional_t<std::is_void_v<R>, bool, std::optional<R>>;
+
+    LuaFunction() { std::fill(std::begin(slotRefs), std::end(slotRefs), LUA_NOREF); }
+    LuaFunction(lua_State* ls, const char* globalName)
+        : LuaFunction()
+    {
+        bind(ls, globalName);
+    }
+    ~LuaFunction() { reset(); }
+
+    LuaFunction(const LuaFunction&) = delete;
+    LuaFunction& operator=(const LuaFunction&) = delete;
+
+    explicit operator bool() const { return funcRef != LUA_NOREF; }
+
+    // resolves the global once, call again after the script is reloaded
+    bool bind(lua_State* ls, const char* globalName)
+    {
+        lua_getglobal(ls, globalName);
+        return bindTop(ls);
+    }
+
+    // takes ownership of the value on top of the stack
+    bool bindTop(lua_State* ls)
+    {
+        reset();
+        if (!lua_isfunction(ls, -1)) {
+            lua_pop(ls, 1);
+            return false;
+        }
+
+        L = ls;
+        funcRef = luaL_ref(L, LUA_REGISTRYINDEX);
+        int i = 0;
+        ((slotRefs[i++] = newSlot<Args>()), ...);
+        return true;
+    }
+
+    void reset()
+    {
+        if (!L)
+            return;
+        luaL_unref(L, LUA_REGISTRYINDEX, funcRef);
+        for (int& ref : slotRefs) {
+            luaL_unref(L, LUA_REGISTRYINDEX, ref);
+            ref = LUA_NOREF;
+        }
+        funcRef = LUA_NOREF;
+        L = nullptr;
+    }
+
+    Result operator()(const Args&... args)
+    {
+        if (!L)
+            return Result {};
+
+        lua_rawgeti(L, LUA_REGISTRYINDEX, funcRef);
+        int i = 0;
+        (LuaTraits<Args>::pushSlot(L, args, slotRefs[i++]), ...);
+
+        if (lua_pcall(L, numArgs, numResults, 0) != LUA_OK) {
+            printf("Lua error: %s\n", lua_tostring(L, -1));
+            lua_pop(L, 1);
+            return Result {};
+        }
+
+        if constexpr (std::is_void_v<R>) {
+            return true;
+        } else {
+            R out {};
+            const bool ok = LuaTraits<R>::get(L, -numResults, out);
+            lua_pop(L, numResults);
+            return ok ? Result(std::move(out)) : Result {};
+        }
+    }
+
+private:
+    template <typename T>
+    int newSlot()
+    {
+        if constexpr (LuaTraits<T>::pooled)
+            return LuaTraits<T>::newSlot(L);
+        else
+            return LUA_NOREF;
+    }
+};
+
+//
+// SCHEMA
+//
+// luaDecode fills a C++ struct from a Lua table in one lua_next pass. A struct
+// opts in with a field list, specialized in the anonymous namespace:
+//     template <> struct LuaSchema<Car> {
+//         static constexpr auto fields = std::make_tuple(luaField("mass", &Car::mass), ...);
+//     };
+// Field names are pushed once per state and kept alive in the registry, so
+// the interned key strings of a table match them by pointer. Members can be
+// numbers, bool, std::string, Vec3/Quat, schema structs, std::vector (Lua
+// arrays) and std::unordered_map<std::string, T>. Missing fields keep their
+// value and unknown keys are ignored; a type mismatch stops with a path like
+// "cars[3].mass: number expected, got string".
+//
+
+template <typename T>
+struct LuaSchema { };
+
+template <typename T, typename M>
+struct LuaSchemaField {
+    const char* name;
+    M T::*member;
+};
+
+template <typename T, typename M>
+constexpr LuaSchemaField<T, M> luaField(const char* name, M T::*member) { return { name, member }; }
+
+template <typename T, typename = void>
+struct LuaDecode;
+
+// LUAI_MAXSHORTLEN: longer strings are not interned and compare by content
+constexpr size_t luaMaxShortLength = 40;
+
+// builds the error path while the decoders unwind
+struct LuaDecodeError {
+    std::string path;
+    std::string message;
+
+    bool fail(lua_State* L, int index, const char* expected)
+    {
+        message = std::string(expected) + " expected, got " + luaL_typename(L, index);
         return false;
     }
+    void prefixField(const char* name) { path = path.empty() || path[0] == '[' ? name + path : name + ("." + path); }
+    void prefixIndex(lua_Integer i) { path = "[" + std::to_string(i) + "]" + path; }
+};
+
+template <typename T>
+struct LuaDecode<T, std::enable_if_t<std::is_arithmetic_v<T> || std::is_same_v<T, Vec3> || std::is_same_v<T, Quat>>> {
+    static bool decode(lua_State* L, int index, T& out, LuaDecodeError& error)
+    {
+        if constexpr (std::is_same_v<T, bool>) {
+            if (lua_type(L, index) != LUA_TBOOLEAN)
+                return error.fail(L, index, "boolean");
+        } else if constexpr (std::is_arithmetic_v<T>) {
+            if (lua_type(L, index) != LUA_TNUMBER) // no string coercion in configs
+                return error.fail(L, index, "number");
+        }
+        if (LuaTraits<T>::get(L, index, out))
+            return true;
+        if constexpr (std::is_integral_v<T>)
+            return error.fail(L, index, "integer");
+        else
+            return error.fail(L, index, std::is_same_v<T, Vec3> ? "vec3" : "quat");
+    }
+};
+
+template <>
+struct LuaDecode<std::string> {
+    static bool decode(lua_State* L, int index, std::string& out, LuaDecodeError& error)
+    {
+        if (lua_type(L, index) != LUA_TSTRING)
+            return error.fail(L, index, "string");
+        size_t length;
+        const char* s = lua_tolstring(L, index, &length);
+        out.assign(s, length);
+        return true;
+    }
+};
+
+template <typename T>
+struct LuaDecode<std::vector<T>> {
+    static bool decode(lua_State* L, int index, std::vector<T>& out, LuaDecodeError& error)
+    {
+        if (!lua_istable(L, index))
+            return error.fail(L, index, "table");
+        const lua_Integer n = (lua_Integer)lua_rawlen(L, index);
+        out.resize((size_t)n);
+        for (lua_Integer i = 1; i <= n; ++i) {
+            lua_rawgeti(L, index, i);
+            const bool ok = LuaDecode<T>::decode(L, -1, out[i - 1], error);
+            lua_pop(L, 1);
+            if (!ok) {
+                error.prefixIndex(i);
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+template <typename T>
+struct LuaDecode<std::unordered_map<std::string, T>> {
+    static bool decode(lua_State* L, int index, std::unordered_map<std::string, T>& out, LuaDecodeError& error)
+    {
+        if (!lua_istable(L, index))
+            return error.fail(L, index, "table");
+        index = lua_absindex(L, index);
+        lua_pushnil(L);
+        while (lua_next(L, index)) {
+            if (lua_type(L, -2) == LUA_TSTRING) {
+                size_t length;
+                const char* key = lua_tolstring(L, -2, &length);
+                if (!LuaDecode<T>::decode(L, -1, out[std::string(key, length)], error)) {
+                    error.prefixField(key);
+                    lua_pop(L, 2);
+                    return false;
+                }
+            }
+            lua_pop(L, 1);
+        }
+        return true;
+    }
+};
+
+// field names interned in one state, anchored by the userdata's user value
+template <typename T>
+struct LuaSchemaKeys {
+    static constexpr size_t count = std::tuple_size_v<decltype(LuaSchema<T>::fields)>;
+    static inline char registryKey;
+
+    const char* names[count];
+    size_t lengths[count];
 
-    // Push 2 Vec3 args
-    pushVec3(L, a);
-    pushVec3(L, b);
+    int find(const char* key, size_t length) const
+    {
+        for (size_t i = 0; i < count; ++i)
+            if (names[i] == key)
+                return (int)i;
+        if (length > luaMaxShortLength) // long strings are separate objects
+            for (size_t i = 0; i < count; ++i)
+                if (lengths[i] == length && memcmp(names[i], key, length) == 0)
+                    return (int)i;
+        return -1;
+    }
 
-    // Call: 2 args, expecting 2 returns
-    if (lua_pcall(L, 2, 2, 0) != LUA_OK) {
-        const char* err = lua_tostring(L, -1);
-        printf("Lua error: %s\n", err);
+    static const LuaSchemaKeys& get(lua_State* L)
+    {
+        lua_rawgetp(L, LUA_REGISTRYINDEX, &registryKey);
+        if (auto* keys = (const LuaSchemaKeys*)lua_touserdata(L, -1)) {
+            lua_pop(L, 1);
+            return *keys;
+        }
         lua_pop(L, 1);
-        return false;
+
+        auto* keys = (LuaSchemaKeys*)lua_newuserdatauv(L, sizeof(LuaSchemaKeys), 1);
+        lua_createtable(L, (int)count, 0);
+        size_t i = 0;
+        std::apply([&](const auto&... field) {
+            ((lua_pushstring(L, field.name),
+                 keys->names[i] = lua_tolstring(L, -1, &keys->lengths[i]),
+                 lua_rawseti(L, -2, (lua_Integer)++i)),
+                ...);
+        },
+            LuaSchema<T>::fields);
+        lua_setiuservalue(L, -2, 1);
+        lua_rawsetp(L, LUA_REGISTRYINDEX, &registryKey);
+        return *keys;
     }
+};
 
-    // Read return values (in reverse order)
-    out2 = (float)lua_tonumber(L, -1);
-    out1 = (float)lua_tonumber(L, -2);
-    lua_pop(L, 2);
+template <typename T>
+struct LuaDecode<T, std::void_t<decltype(LuaSchema<T>::fields)>> {
+    static bool decode(lua_State* L, int index, T& out, LuaDecodeError& error)
+    {
+        if (!lua_istable(L, index))
+            return error.fail(L, index, "table");
+        index = lua_absindex(L, index);
+        const LuaSchemaKeys<T>& keys = LuaSchemaKeys<T>::get(L);
 
-    return true;
+        lua_pushnil(L);
+        while (lua_next(L, index)) {
+            if (lua_type(L, -2) == LUA_TSTRING) {
+                size_t length;
+                const char* key = lua_tolstring(L, -2, &length);
+                const int field = keys.find(key, length);
+                if (field >= 0 && !decodeField(L, out, field, error, std::make_index_sequence<LuaSchemaKeys<T>::count>())) {
+                    error.prefixField(keys.names[field]);
+                    lua_pop(L, 2);
+                    return false;
+                }
+            }
+            lua_pop(L, 1);
+        }
+        return true;
+    }
+
+private:
+    // the value on top of the stack into field number `field`
+    template <size_t... I>
+    static bool decodeField(lua_State* L, T& out, int field, LuaDecodeError& error, std::index_sequence<I...>)
+    {
+        bool ok = true;
+        ((I == (size_t)field ? (ok = decodeMember(L, out, std::get<I>(LuaSchema<T>::fields), error)) : false), ...);
+        return ok;
+    }
+
+    template <typename M>
+    static bool decodeMember(lua_State* L, T& out, const LuaSchemaField<T, M>& field, LuaDecodeError& error)
+    {
+        return LuaDecode<M>::decode(L, -1, out.*field.member, error);
+    }
+};
+
+// the table at index into out; the error is "path: message" when given
+template <typename T>
+bool luaDecode(lua_State* L, int index, T& out, std::string* error = nullptr)
+{
+    LuaDecodeError decodeError;
+    if (LuaDecode<T>::decode(L, index, out, decodeError))
+        return true;
+    if (error)
+        *error = decodeError.path.empty() ? decodeError.message : decodeError.path + ": " + decodeError.message;
+    return false;
 }
 
+//
+// BOT
+//
+
+// processVecs(a, b) -> dot, dist
+using ProcessVecsFunction = LuaFunction<std::tuple<float, float>(Vec3, Vec3)>;
+
 void registerMathFunctions(lua_State* L)
 {
+    // all metatables must exist before the first closure captures them
+    for (int meta = 1; meta <= MetaUpvalueCount; ++meta) {
+        luaL_newmetatable(L, metaNames[meta]);
+        lua_rawsetp(L, LUA_REGISTRYINDEX, &metaRegistryKeys[meta]);
+    }
+
     { // VEC3
-        lua_register(L, "vec3", vec3_new);
-        lua_register(L, "dot", vec3_dot);
-        lua_register(L, "cross", vec3_cross);
-
-        luaL_newmetatable(L, "Vec3Meta");
-        lua_pushcfunction(L, vec3_add), lua_setfield(L, -2, "__add");
-        lua_pushcfunction(L, vec3_sub), lua_setfield(L, -2, "__sub");
-        lua_pushcfunction(L, vec3_mul), lua_setfield(L, -2, "__mul");
-        lua_pushcfunction(L, vec3_div), lua_setfield(L, -2, "__div");
-        lua_pushcfunction(L, vec3_tostring), lua_setfield(L, -2, "__tostring");
-        lua_pushcfunction(L, vec3_index_getter), lua_setfield(L, -2, "__index");
-        lua_pushcfunction(L, vec3_index_setter), lua_setfield(L, -2, "__newindex");
+        registerMathFunction(L, "vec3", vec3_new);
+        registerMathFunction(L, "dot", vec3_dot);
+        registerMathFunction(L, "cross", vec3_cross);
+
+        pushMetatable(L, Vec3MetaUpvalue);
+        pushMathFunction(L, vec3_add), lua_setfield(L, -2, "__add");
+        pushMathFunction(L, vec3_sub), lua_setfield(L, -2, "__sub");
+        pushMathFunction(L, vec3_mul), lua_setfield(L, -2, "__mul");
+        pushMathFunction(L, vec3_div), lua_setfield(L, -2, "__div");
+        pushMathFunction(L, vec3_tostring), lua_setfield(L, -2, "__tostring");
+        pushMathFunction(L, vec3_index_getter), lua_setfield(L, -2, "__index");
+        pushMathFunction(L, vec3_index_setter), lua_setfield(L, -2, "__newindex");
         lua_pop(L, 1);
     }
 
     { // QUAT
-        lua_register(L, "quat", quat_new);
-        lua_register(L, "inverse", inverse);
+        registerMathFunction(L, "quat", quat_new);
+        registerMathFunction(L, "inverse", inverse);
+
+        pushMetatable(L, QuatMetaUpvalue);
+        pushMathFunction(L, quat_mul), lua_setfield(L, -2, "__mul");
+        pushMathFunction(L, quat_tostring), lua_setfield(L, -2, "__tostring");
+        lua_pop(L, 1);
+    }
+
+    { // TRANSFORM
+        registerMathFunction(L, "transform", transform_new);
+
+        pushMetatable(L, TransformMetaUpvalue);
+        pushMathFunction(L, transform_mul), lua_setfield(L, -2, "__mul");
+        pushMathFunction(L, transform_tostring), lua_setfield(L, -2, "__tostring");
+        pushMathFunction(L, transform_newindex), lua_setfield(L, -2, "__newindex");
 
-        luaL_newmetatable(L, "QuatMeta");
-        lua_pushcfunction(L, quat_mul), lua_setfield(L, -2, "__mul");
-        lua_pushcfunction(L, quat_tostring), lua_setfield(L, -2, "__tostring");
+        lua_newtable(L);
+        pushMathFunction(L, transform_transformPoint), lua_setfield(L, -2, "transformPoint");
+        pushMathFunction(L, transform_inverseTransformPoint), lua_setfield(L, -2, "inverseTransformPoint");
+        pushMathFunction(L, transform_transformPoints<false>), lua_setfield(L, -2, "transformPoints");
+        pushMathFunction(L, transform_transformPoints<true>), lua_setfield(L, -2, "inverseTransformPoints");
+        pushMathFunction(L, transform_compose), lua_setfield(L, -2, "compose");
+        pushMathFunction(L, transform_inverse), lua_setfield(L, -2, "inverse");
+        pushMathFunction(L, transform_lerp), lua_setfield(L, -2, "lerp");
+        pushMathFunction(L, transform_slerp), lua_setfield(L, -2, "slerp");
+        pushMathFunction(L, transform_index, 1), lua_setfield(L, -2, "__index");
         lua_pop(L, 1);
     }
 
-    lua_register(L, "normalize", normalize);
+    registerMathFunction(L, "normalize", normalize);
 
     { // road spline
-        lua_register(L, "roadSplineLength", roadSplineLength);
-        lua_register(L, "roadSplineLength", roadSplineNumSegments);
-        lua_register(L, "roadSplineDistanceToKey", roadSplineDistanceToKey);
-        lua_register(L, "roadSplineKeyToDistance", roadSplineKeyToDistance);
-        lua_register(L, "roadSplinePositionAtKey", roadSplinePositionAtKey);
-        lua_register(L, "roadSplinePositionRotationAtKey", roadSplinePositionAndRotationAtKey);
-        lua_register(L, "roadSplineKeyClosestToPosition", roadSplineKeyClosestToPosition);
+        registerMathFunction(L, "roadSplineLength", roadSplineLength);
+        registerMathFunction(L, "roadSplineNumSegments", roadSplineNumSegments);
+        registerMathFunction(L, "roadSplineDistanceToKey", roadSplineDistanceToKey);
+        registerMathFunction(L, "roadSplineKeyToDistance", roadSplineKeyToDistance);
+        registerMathFunction(L, "roadSplinePositionAtKey", roadSplinePositionAtKey);
+        new (lua_newuserdatauv(L, sizeof(SplineFrameCache), 0)) SplineFrameCache();
+        pushMathFunction(L, roadSplinePositionAndRotationAtKey, 1);
+        lua_setglobal(L, "roadSplinePositionAndRotationAtKey");
+        registerMathFunction(L, "roadSplineKeyClosestToPosition", roadSplineKeyClosestToPosition);
+    }
+
+    { // FloatArray
+        registerMathFunction(L, "FloatArray", floatArray_new);
+
+        pushMetatable(L, FloatArrayMetaUpvalue);
+        pushMathFunction(L, floatArray_len), lua_setfield(L, -2, "__len");
+        pushMathFunction(L, floatArray_tostring), lua_setfield(L, -2, "__tostring");
+
+        lua_newtable(L);
+        pushMathFunction(L, floatArray_get), lua_setfield(L, -2, "get");
+        pushMathFunction(L, floatArray_set), lua_setfield(L, -2, "set");
+        pushMathFunction(L, floatArray_fill), lua_setfield(L, -2, "fill");
+        pushMathFunction(L, floatArray_slice), lua_setfield(L, -2, "slice");
+        pushMathFunction(L, floatArray_toTable), lua_setfield(L, -2, "toTable");
+        lua_setfield(L, -2, "__index");
+        lua_pop(L, 1);
+    }
+
+    { // Vec3Array
+        registerMathFunction(L, "Vec3Array", vec3Array_new);
+
+        pushMetatable(L, Vec3ArrayMetaUpvalue);
+        pushMathFunction(L, vec3Array_len), lua_setfield(L, -2, "__len");
+        pushMathFunction(L, vec3Array_tostring), lua_setfield(L, -2, "__tostring");
+
+        lua_newtable(L);
+        pushMathFunction(L, vec3Array_get), lua_setfield(L, -2, "get");
+        pushMathFunction(L, vec3Array_set), lua_setfield(L, -2, "set");
+        pushMathFunction(L, vec3Array_slice), lua_setfield(L, -2, "slice");
+        pushMathFunction(L, vec3Array_add), lua_setfield(L, -2, "add");
+        pushMathFunction(L, vec3Array_sub), lua_setfield(L, -2, "sub");
+        pushMathFunction(L, vec3Array_mul), lua_setfield(L, -2, "mul");
+        pushMathFunction(L, vec3Array_scale), lua_setfield(L, -2, "scale");
+        pushMathFunction(L, vec3Array_dot), lua_setfield(L, -2, "dot");
+        pushMathFunction(L, vec3Array_length), lua_setfield(L, -2, "length");
+        pushMathFunction(L, vec3Array_normalize), lua_setfield(L, -2, "normalize");
+        pushMathFunction(L, vec3Array_lerp), lua_setfield(L, -2, "lerp");
+        pushMathFunction(L, vec3Array_transform), lua_setfield(L, -2, "transform");
+        lua_setfield(L, -2, "__index");
+        lua_pop(L, 1);
+    }
+
+    { // KERNELS
+        registerMathFunction(L, "kernel", kernel_new);
+
+        pushMetatable(L, KernelMetaUpvalue);
+        pushMathFunction(L, kernel_call), lua_setfield(L, -2, "__call");
+        pushMathFunction(L, kernel_tostring), lua_setfield(L, -2, "__tostring");
+        lua_pop(L, 1);
+    }
+
+    { // shared blobs
+        registerMathFunction(L, "blobFloats", blobFloats);
+        registerMathFunction(L, "blobVec3s", blobVec3s);
+        registerMathFunction(L, "blobString", blobString);
+        registerMathFunction(L, "blobNumStrings", blobNumStrings);
     }
 
     {
-        luaL_newmetatable(L, "Arr2d");
+        pushMetatable(L, Arr2dMetaUpvalue);
 
-        lua_pushcfunction(L, l_Arr2d_gc), lua_setfield(L, -2, "__gc");
-        lua_register(L, "Arr2d", l_Arr2d_new);
+        // Arr2d is a table: Arr2d({...}) via __call, Arr2d.load(path)
+        lua_newtable(L);
+        lua_createtable(L, 0, 2);
+        lua_pushcfunction(L, arr2dFile_close), lua_setfield(L, -2, "__gc");
+        lua_pushcfunction(L, arr2dFile_close), lua_setfield(L, -2, "__close");
+        pushMathFunction(L, l_Arr2d_load, 1), lua_setfield(L, -2, "load");
+        pushMathFunction(L, l_Arr2d_grid), lua_setfield(L, -2, "grid");
+        lua_newtable(L);
+        pushMathFunction(L, l_Arr2d_call), lua_setfield(L, -2, "__call");
+        lua_setmetatable(L, -2);
+        lua_setglobal(L, "Arr2d");
 
         // method table
         lua_newtable(L);
-        lua_pushcfunction(L, l_Arr2d_get), lua_setfield(L, -2, "get");
-        lua_pushcfunction(L, l_Arr2d_set), lua_setfield(L, -2, "set");
-        lua_pushcfunction(L, l_Arr2d_getRow), lua_setfield(L, -2, "getRow");
-        lua_pushcfunction(L, l_Arr2d_getBinarySearchByCol), lua_setfield(L, -2, "binarySearchByCol");
+        pushMathFunction(L, l_Arr2d_get), lua_setfield(L, -2, "get");
+        pushMathFunction(L, l_Arr2d_set), lua_setfield(L, -2, "set");
+        pushMathFunction(L, l_Arr2d_size), lua_setfield(L, -2, "size");
+        pushMathFunction(L, l_Arr2d_getRow), lua_setfield(L, -2, "getRow");
+        pushMathFunction(L, l_Arr2d_row), lua_setfield(L, -2, "row");
+        pushMathFunction(L, l_Arr2d_col), lua_setfield(L, -2, "col");
+        pushMathFunction(L, l_Arr2d_getBinarySearchByCol), lua_setfield(L, -2, "binarySearchByCol");
+        pushMathFunction(L, l_Arr2d_save), lua_setfield(L, -2, "save");
+        pushMathFunction(L, l_Arr2d_buildIndex), lua_setfield(L, -2, "buildIndex");
+        pushMathFunction(L, l_Arr2d_findRange), lua_setfield(L, -2, "findRange");
+        pushMathFunction(L, l_Arr2d_nearest), lua_setfield(L, -2, "nearest");
         lua_setfield(L, -2, "__index"); // metatable.__index = methods
         lua_pop(L, 1); // pop metatable
+
+        pushMetatable(L, Arr2dViewMetaUpvalue);
+        pushMathFunction(L, l_Arr2dView_len), lua_setfield(L, -2, "__len");
+
+        lua_newtable(L);
+        pushMathFunction(L, l_Arr2dView_get), lua_setfield(L, -2, "get");
+        pushMathFunction(L, l_Arr2dView_set), lua_setfield(L, -2, "set");
+        pushMathFunction(L, l_Arr2dView_toTable), lua_setfield(L, -2, "toTable");
+        lua_setfield(L, -2, "__index");
+        lua_pop(L, 1);
+
+        pushMetatable(L, Arr2dGridMetaUpvalue);
+        lua_newtable(L);
+        pushMathFunction(L, l_Arr2dGrid_sample), lua_setfield(L, -2, "sample");
+        pushMathFunction(L, l_Arr2dGrid_sampleMany), lua_setfield(L, -2, "sampleMany");
+        pushMathFunction(L, l_Arr2dGrid_size), lua_setfield(L, -2, "size");
+        lua_setfield(L, -2, "__index");
+        lua_pop(L, 1);
     }
 }
 } // namespace
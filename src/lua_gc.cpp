@@ -0,0 +1,82 @@
+#include "lua_gc.h"
+
+#include <algorithm>
+#include <chrono>
+
+extern "C" {
+#include <lua.h>
+}
+
+namespace {
+constexpr int minStepKb = 8;
+constexpr int maxStepKb = 4096;
+constexpr int stepsPerFrame = 4; // step size target: allocation rate / stepsPerFrame
+constexpr float allocRateSmoothing = 0.1f;
+constexpr int emergencyFactor = 3; // live set grew past 3x the size after the last cycle
+constexpr int emergencyFloorKb = 16 * 1024;
+
+double now()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+} // namespace
+
+LuaGcScheduler::LuaGcScheduler(lua_State* L)
+    : L(L)
+{
+    lua_gc(L, LUA_GCSTOP);
+    m_stats.stepKb = 64;
+    m_kbAfterStep = m_kbAfterCycle = countKb();
+}
+
+int LuaGcScheduler::countKb() const
+{
+    return lua_gc(L, LUA_GCCOUNT);
+}
+
+void LuaGcScheduler::step(double budgetSeconds)
+{
+    const double start = now();
+    const int kbBefore = countKb();
+    m_stats.allocRateKb += (std::max(kbBefore - m_kbAfterStep, 0) - m_stats.allocRateKb) * allocRateSmoothing;
+    m_stats.frameSteps = 0;
+
+    if (kbBefore > std::max(m_kbAfterCycle * emergencyFactor, emergencyFloorKb)) {
+        // the budget cannot keep up, take one hitch instead of growing without bound
+        lua_gc(L, LUA_GCCOLLECT);
+        ++m_stats.cycles;
+        ++m_stats.emergencyCollects;
+        m_kbAfterCycle = countKb();
+
+    } else {
+        const int targetStepKb = std::clamp(int(m_stats.allocRateKb / stepsPerFrame), minStepKb, maxStepKb);
+        float debtKb = std::max(m_stats.allocRateKb, (float)minStepKb);
+
+        while (debtKb > 0) {
+            const double stepStart = now();
+            if (stepStart - start >= budgetSeconds)
+                break;
+
+            const bool cycleDone = lua_gc(L, LUA_GCSTEP, m_stats.stepKb);
+            ++m_stats.frameSteps;
+            debtKb -= m_stats.stepKb;
+
+            const double stepTime = now() - stepStart;
+            if (stepTime > budgetSeconds * 0.5)
+                m_stats.stepKb = std::max(m_stats.stepKb / 2, minStepKb);
+            else if (stepTime < budgetSeconds * 0.125 && m_stats.stepKb < targetStepKb)
+                m_stats.stepKb = std::min(m_stats.stepKb * 2, targetStepKb);
+
+            if (cycleDone) {
+                ++m_stats.cycles;
+                m_kbAfterCycle = countKb();
+                break;
+            }
+        }
+    }
+
+    m_kbAfterStep = countKb();
+    m_stats.frameMs = (now() - start) * 1000.0;
+    m_frameMsHistory[m_historyOffset] = (float)m_stats.frameMs;
+    m_historyOffset = (m_historyOffset + 1) % historySize;
+}
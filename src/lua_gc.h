@@ -0,0 +1,52 @@
+#ifndef LUA_GC_H
+#define LUA_GC_H
+
+#include <cstdint>
+
+struct lua_State;
+
+// Takes the collector off allocation debt and runs it in per-frame slices.
+// Call step() once a frame where a hitch is cheapest (right after the swap),
+// with the time left before the next frame's work has to start.
+// The step size follows the allocation rate: a frame tries to collect what
+// the previous frames allocated, and halves the step when one step alone
+// eats most of the budget.
+class LuaGcScheduler {
+public:
+    static constexpr int historySize = 240; // frames
+
+    struct Stats {
+        double frameMs = 0; // GC time spent in the last step()
+        int frameSteps = 0;
+        int stepKb = 0; // current LUA_GCSTEP size
+        float allocRateKb = 0; // smoothed growth per frame
+        uint64_t cycles = 0; // completed GC cycles
+        uint64_t emergencyCollects = 0; // full collections because the budget fell behind
+    };
+
+    // stops automatic collection for the lifetime of L
+    explicit LuaGcScheduler(lua_State* L);
+
+    LuaGcScheduler(const LuaGcScheduler&) = delete;
+    LuaGcScheduler& operator=(const LuaGcScheduler&) = delete;
+
+    void step(double budgetSeconds);
+
+    const Stats& getStats() const { return m_stats; }
+
+    // ring buffer for ImGui::PlotLines, oldest value at getHistoryOffset()
+    const float* getFrameMsHistory() const { return m_frameMsHistory; }
+    int getHistoryOffset() const { return m_historyOffset; }
+
+private:
+    int countKb() const;
+
+    lua_State* const L;
+    Stats m_stats;
+    int m_kbAfterStep = 0;
+    int m_kbAfterCycle = 0;
+    float m_frameMsHistory[historySize] = {};
+    int m_historyOffset = 0;
+};
+
+#endif // LUA_GC_H
@@ -0,0 +1,116 @@
+#include "lua_hooks.h"
+
+#include <algorithm>
+#include <new>
+#include <vector>
+
+extern "C" {
+#include <lauxlib.h>
+#include <lua.h>
+}
+
+namespace {
+char hooksKey; // registry: LuaHooks userdata
+
+struct Client {
+    LuaHookClient function;
+    void* userdata;
+    int period;
+    int countdown;
+};
+
+struct LuaHooks {
+    std::vector<Client> clients;
+    int count = 0; // hook period, the shortest client period
+};
+
+LuaHooks* getHooks(lua_State* L, bool create)
+{
+    lua_rawgetp(L, LUA_REGISTRYINDEX, &hooksKey);
+    auto* hooks = (LuaHooks*)lua_touserdata(L, -1);
+    lua_pop(L, 1);
+    if (hooks || !create)
+        return hooks;
+
+    hooks = new (lua_newuserdatauv(L, sizeof(LuaHooks), 0)) LuaHooks();
+    lua_createtable(L, 0, 1);
+    lua_pushcfunction(L, [](lua_State* L) {
+        ((LuaHooks*)lua_touserdata(L, 1))->~LuaHooks();
+        return 0;
+    });
+    lua_setfield(L, -2, "__gc");
+    lua_setmetatable(L, -2);
+    lua_rawsetp(L, LUA_REGISTRYINDEX, &hooksKey);
+    return hooks;
+}
+
+// no objects with destructors here, clients may longjmp out through it
+void dispatch(lua_State* L, lua_Debug*)
+{
+    LuaHooks* hooks = getHooks(L, false);
+    if (!hooks || hooks->clients.empty()) {
+        lua_sethook(L, nullptr, 0, 0);
+        return;
+    }
+
+    const int elapsed = lua_gethookcount(L);
+    if (elapsed != hooks->count) // a thread still on an earlier period
+        lua_sethook(L, dispatch, LUA_MASKCOUNT, hooks->count);
+
+    bool yield = false;
+    for (size_t i = 0; i < hooks->clients.size(); ++i) {
+        Client& client = hooks->clients[i];
+        client.countdown -= elapsed;
+        if (client.countdown > 0)
+            continue;
+        client.countdown = client.period;
+        const LuaHookClient function = client.function;
+        yield |= function(L, client.userdata);
+    }
+
+    if (yield && lua_isyieldable(L))
+        lua_yield(L, 0);
+}
+
+void update(lua_State* L, LuaHooks* hooks)
+{
+    if (hooks->clients.empty()) {
+        hooks->count = 0;
+        lua_sethook(L, nullptr, 0, 0);
+        return;
+    }
+
+    hooks->count = hooks->clients[0].period;
+    for (const Client& client : hooks->clients)
+        hooks->count = std::min(hooks->count, client.period);
+    lua_sethook(L, dispatch, LUA_MASKCOUNT, hooks->count);
+}
+} // namespace
+
+void addLuaHook(lua_State* L, LuaHookClient client, void* userdata, int period)
+{
+    period = std::max(period, 1);
+    LuaHooks* hooks = getHooks(L, true);
+    hooks->clients.push_back({ client, userdata, period, period });
+    update(L, hooks);
+}
+
+void removeLuaHook(lua_State* L, LuaHookClient client, void* userdata)
+{
+    LuaHooks* hooks = getHooks(L, false);
+    if (!hooks)
+        return;
+
+    auto& clients = hooks->clients;
+    clients.erase(std::remove_if(clients.begin(), clients.end(),
+                      [&](const Client& c) { return c.function == client && c.userdata == userdata; }),
+        clients.end());
+    update(L, hooks);
+}
+
+void installLuaHooks(lua_State* thread)
+{
+    LuaHooks* hooks = getHooks(thread, false);
+    if (hooks && !hooks->clients.empty() && lua_gethook(thread) != dispatch)
+        lua_sethook(thread, dispatch, LUA_MASKCOUNT, hooks->count);
+}
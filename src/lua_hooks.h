@@ -0,0 +1,18 @@
+#ifndef LUA_HOOKS_H
+#define LUA_HOOKS_H
+
+struct lua_State;
+
+// lua_sethook keeps a single hook per thread; these share one count hook
+// between clients, each called about every `period` instructions run by any
+// thread of the state. A client may raise a Lua error, or return true to
+// yield the running coroutine when it is yieldable (a hook yields no values).
+// Threads copy the hook when they are created: call installLuaHooks on the
+// threads that existed before the first client was added.
+using LuaHookClient = bool (*)(lua_State* L, void* userdata);
+
+void addLuaHook(lua_State* L, LuaHookClient client, void* userdata, int period);
+void removeLuaHook(lua_State* L, LuaHookClient client, void* userdata);
+void installLuaHooks(lua_State* thread);
+
+#endif // LUA_HOOKS_H
@@ -0,0 +1,174 @@
+#include "lua_live.h"
+
+#include "lua_alloc.h"
+#include "lua_functions.h"
+#include "lua_hooks.h"
+#include "lua_watchdog.h"
+
+#include <cstdio>
+#include <cstring>
+
+namespace {
+const char chunkName[] = "=editor";
+constexpr size_t maxOutput = 64 * 1024;
+constexpr int cancelCheckPeriod = 1000;
+
+// print(...) into the std::string upvalue
+int l_print(lua_State* L)
+{
+    auto* output = (std::string*)lua_touserdata(L, lua_upvalueindex(1));
+    const int n = lua_gettop(L);
+    for (int i = 1; i <= n && output->size() < maxOutput; ++i) {
+        size_t length;
+        const char* s = luaL_tolstring(L, i, &length);
+        if (i > 1)
+            *output += '\t';
+        output->append(s, length);
+        lua_pop(L, 1);
+    }
+    if (output->size() < maxOutput)
+        *output += '\n';
+    return 0;
+}
+
+// message handler: the innermost editor line into the int upvalue
+int l_errorLine(lua_State* L)
+{
+    auto* line = (int*)lua_touserdata(L, lua_upvalueindex(1));
+    lua_Debug ar;
+    for (int level = 0; lua_getstack(L, level, &ar); ++level) {
+        lua_getinfo(L, "Sl", &ar);
+        if (strcmp(ar.source, chunkName) == 0 && ar.currentline > 0) {
+            *line = ar.currentline;
+            break;
+        }
+    }
+    return 1;
+}
+} // namespace
+
+LuaLiveRunner::LuaLiveRunner(InitFunction init, std::chrono::milliseconds debounce, double budgetSeconds)
+    : m_init(std::move(init))
+    , m_debounce(debounce)
+    , m_budgetSeconds(budgetSeconds)
+    , m_thread([this] { threadMain(); })
+{
+}
+
+LuaLiveRunner::~LuaLiveRunner()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_quit = true;
+        ++m_revision; // cancels the current run
+    }
+    m_wake.notify_one();
+    m_thread.join();
+}
+
+void LuaLiveRunner::submit(std::string source)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_source = std::move(source);
+        m_lastSubmit = std::chrono::steady_clock::now();
+        ++m_revision;
+    }
+    m_wake.notify_one();
+}
+
+bool LuaLiveRunner::poll(Result& result)
+{
+    std::unique_lock<std::mutex> lock(m_mutex, std::try_to_lock);
+    if (!lock || !m_hasResult)
+        return false;
+    result = std::move(m_result);
+    m_hasResult = false;
+    return true;
+}
+
+void LuaLiveRunner::threadMain()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (;;) {
+        m_wake.wait(lock, [this] { return m_quit || m_revision != m_runningRevision; });
+
+        // debounce: every submit pushes the deadline back
+        while (!m_quit && std::chrono::steady_clock::now() < m_lastSubmit + m_debounce)
+            m_wake.wait_until(lock, m_lastSubmit + m_debounce);
+        if (m_quit)
+            break;
+
+        const std::string source = m_source;
+        m_runningRevision = m_revision;
+        lock.unlock();
+
+        Result result;
+        result.revision = m_runningRevision;
+        run(source, result);
+
+        lock.lock();
+        if (result.revision == m_revision) { // drop results of superseded text
+            m_result = std::move(result);
+            m_hasResult = true;
+        }
+    }
+}
+
+void LuaLiveRunner::run(const std::string& source, Result& result)
+{
+    const auto start = std::chrono::steady_clock::now();
+
+    LuaAllocator allocator;
+    lua_State* L = allocator.newState();
+    luaL_openlibs(L);
+    registerMathFunctions(L);
+    if (m_init)
+        m_init(L);
+    lua_pushlightuserdata(L, &result.output);
+    lua_pushcclosure(L, l_print, 1);
+    lua_setglobal(L, "print");
+
+    LuaWatchdog watchdog(L);
+    addLuaHook(L, cancelHook, this, cancelCheckPeriod);
+
+    int errorLine = 0;
+    int status = luaL_loadbuffer(L, source.data(), source.size(), chunkName);
+    if (status == LUA_OK) {
+        lua_pushlightuserdata(L, &errorLine);
+        lua_pushcclosure(L, l_errorLine, 1);
+        lua_insert(L, -2);
+        LuaWatchdog::Guard guard(watchdog, "editor", { 0, m_budgetSeconds });
+        status = lua_pcall(L, 0, 0, -2);
+    }
+
+    result.ok = status == LUA_OK;
+    if (!result.ok) {
+        const char* error = lua_tostring(L, -1);
+        std::string message = error ? error : "(error object is not a string)";
+
+        // compile errors and most runtime errors start with "editor:<line>:"
+        int line = 0, prefix = 0;
+        if (sscanf(message.c_str(), "editor:%d:%n", &line, &prefix) == 1 && prefix > 0) {
+            message.erase(0, message.find_first_not_of(' ', prefix));
+            if (!errorLine)
+                errorLine = line;
+        }
+        result.errors[errorLine > 0 ? errorLine : 1] = message;
+        result.output += message;
+        result.output += '\n';
+    }
+
+    removeLuaHook(L, cancelHook, this);
+    watchdog.stop();
+    lua_close(L);
+    result.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+bool LuaLiveRunner::cancelHook(lua_State* L, void* userdata)
+{
+    auto* self = (LuaLiveRunner*)userdata;
+    if (self->m_revision != self->m_runningRevision)
+        luaL_error(L, "cancelled by a newer edit");
+    return false;
+}
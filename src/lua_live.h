@@ -0,0 +1,67 @@
+#ifndef LUA_LIVE_H
+#define LUA_LIVE_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+
+struct lua_State;
+
+// Runs a script buffer, the editor text, on a background thread. Every run
+// gets a fresh lua_State with registerMathFunctions, then init(L) for what
+// the other states get from the host (shared blobs, ...). The newest submitted text
+// runs once edits pause for `debounce`; a run still going when newer text
+// arrives is cancelled, and one over budgetSeconds is aborted. print() output
+// and errors come back through poll(), which never blocks the render thread.
+class LuaLiveRunner {
+public:
+    struct Result {
+        uint64_t revision = 0; // the submit() the result belongs to, counted from 1
+        bool ok = false;
+        double ms = 0.0;
+        std::string output; // print() lines, then the error
+        std::map<int, std::string> errors; // 1-based line -> message, as TextEditor::ErrorMarkers
+    };
+
+    using InitFunction = std::function<void(lua_State*)>;
+
+    explicit LuaLiveRunner(InitFunction init = nullptr,
+        std::chrono::milliseconds debounce = std::chrono::milliseconds(300), double budgetSeconds = 1.0);
+    ~LuaLiveRunner();
+
+    LuaLiveRunner(const LuaLiveRunner&) = delete;
+    LuaLiveRunner& operator=(const LuaLiveRunner&) = delete;
+
+    void submit(std::string source);
+
+    // moves out the result of the newest finished run, if there is a new one
+    bool poll(Result& result);
+
+private:
+    void threadMain();
+    void run(const std::string& source, Result& result);
+    static bool cancelHook(lua_State* L, void* userdata);
+
+    const InitFunction m_init; // called on the runner thread
+    const std::chrono::milliseconds m_debounce;
+    const double m_budgetSeconds;
+
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::string m_source;
+    std::chrono::steady_clock::time_point m_lastSubmit;
+    std::atomic<uint64_t> m_revision { 0 }; // newest submit, read by the cancel hook
+    uint64_t m_runningRevision = 0; // worker thread only
+    Result m_result;
+    bool m_hasResult = false;
+    bool m_quit = false;
+    std::thread m_thread;
+};
+
+#endif // LUA_LIVE_H
@@ -0,0 +1,326 @@
+#include "lua_profiler.h"
+
+#include "lua_hooks.h"
+
+#include "imgui.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+
+extern "C" {
+#include <lauxlib.h>
+#include <lua.h>
+}
+
+namespace {
+constexpr int maxDepth = 64;
+constexpr int timerCheckPeriod = 256; // instructions between flag checks in Timer mode
+} // namespace
+
+LuaProfiler::LuaProfiler(lua_State* L)
+    : L(L)
+{
+    clear();
+}
+
+void LuaProfiler::start(Mode mode, int period)
+{
+    stop();
+    m_mode = mode;
+    m_running = true;
+
+    if (mode == Mode::Instructions) {
+        addLuaHook(L, hook, this, period);
+        return;
+    }
+
+    m_timerQuit = false;
+    m_timer = std::thread([this, period] {
+        const auto interval = std::chrono::microseconds(std::max(period, 1));
+        while (!m_timerQuit) {
+            std::this_thread::sleep_for(interval);
+            m_sampleRequested = true;
+        }
+    });
+    addLuaHook(L, hook, this, timerCheckPeriod);
+}
+
+void LuaProfiler::stop()
+{
+    if (!m_running)
+        return;
+
+    removeLuaHook(L, hook, this);
+
+    if (m_timer.joinable()) {
+        m_timerQuit = true;
+        m_timer.join();
+    }
+    m_running = false;
+}
+
+void LuaProfiler::clear()
+{
+    m_nodes.clear();
+    m_nodes.emplace_back(-1, -1);
+}
+
+bool LuaProfiler::hook(lua_State* L, void* userdata)
+{
+    auto* self = (LuaProfiler*)userdata;
+    if (self->m_mode == Mode::Timer && !self->m_sampleRequested.exchange(false))
+        return false;
+    self->sample(L);
+    return false;
+}
+
+void LuaProfiler::sample(lua_State* L)
+{
+    int frames[maxDepth];
+    int depth = 0;
+    lua_Debug ar;
+    for (int level = 0; depth < maxDepth && lua_getstack(L, level, &ar); ++level)
+        frames[depth++] = internFrame(L, ar);
+
+    int node = 0;
+    ++m_nodes[0].total;
+    for (int i = depth - 1; i >= 0; --i) {
+        node = childOf(node, frames[i]);
+        ++m_nodes[node].total;
+    }
+    ++m_nodes[node].self;
+}
+
+// Frames are keyed by definition site (C function pointer for C functions),
+// not by closure: closures created per call and reloaded chunks merge, and a
+// collected closure's address cannot be mistaken for another function.
+int LuaProfiler::internFrame(lua_State* L, lua_Debug& ar)
+{
+    lua_getinfo(L, "Sf", &ar);
+    char site[LUA_IDSIZE + 32];
+    if (ar.what[0] == 'C')
+        snprintf(site, sizeof(site), "%p", (void*)lua_tocfunction(L, -1));
+    else
+        snprintf(site, sizeof(site), "%s:%d", ar.short_src, ar.linedefined);
+
+    uint64_t key = 14695981039346656037ull; // FNV-1a
+    for (const char* c = site; *c; ++c)
+        key = (key ^ (unsigned char)*c) * 1099511628211ull;
+
+    auto it = m_frameIds.find(key);
+    if (it != m_frameIds.end()) {
+        lua_pop(L, 1);
+        return it->second;
+    }
+
+    const int frame = (int)m_frameNames.size();
+    m_frameNames.push_back(frameName(L, ar));
+    m_frameIds.emplace(key, frame);
+    lua_pop(L, 1);
+    return frame;
+}
+
+// expects the function on top of the stack
+std::string LuaProfiler::frameName(lua_State* L, lua_Debug& ar)
+{
+    lua_getinfo(L, "n", &ar);
+    std::string name = ar.name ? ar.name : "";
+    if (name.empty()) { // called from C, try the globals like luaL_traceback does
+        lua_pushglobaltable(L);
+        lua_pushnil(L);
+        while (lua_next(L, -2)) {
+            if (lua_type(L, -2) == LUA_TSTRING && lua_rawequal(L, -1, -4)) {
+                name = lua_tostring(L, -2);
+                lua_pop(L, 2);
+                break;
+            }
+            lua_pop(L, 1);
+        }
+        lua_pop(L, 1);
+    }
+
+    char buf[LUA_IDSIZE + 128];
+    if (ar.what[0] == 'm')
+        snprintf(buf, sizeof(buf), "main chunk (%s)", ar.short_src);
+    else if (ar.what[0] == 'C')
+        snprintf(buf, sizeof(buf), "%s [C]", name.empty() ? "?" : name.c_str());
+    else if (name.empty())
+        snprintf(buf, sizeof(buf), "function <%s:%d>", ar.short_src, ar.linedefined);
+    else
+        snprintf(buf, sizeof(buf), "%s (%s:%d)", name.c_str(), ar.short_src, ar.linedefined);
+    return buf;
+}
+
+int LuaProfiler::childOf(int node, int frame)
+{
+    for (int child : m_nodes[node].children)
+        if (m_nodes[child].frame == frame)
+            return child;
+
+    const int child = (int)m_nodes.size();
+    m_nodes.emplace_back(frame, node);
+    m_nodes[node].children.push_back(child);
+    return child;
+}
+
+std::vector<LuaProfiler::FunctionStats> LuaProfiler::getTopFunctions(int count) const
+{
+    std::vector<FunctionStats> stats(m_frameNames.size());
+    for (int i = 0; i < (int)stats.size(); ++i)
+        stats[i] = { i, 0, 0 };
+
+    std::vector<int> onPath(m_frameNames.size(), 0);
+    std::function<void(int)> visit = [&](int node) {
+        const Node& n = m_nodes[node];
+        if (n.frame >= 0) {
+            stats[n.frame].self += n.self;
+            if (onPath[n.frame]++ == 0)
+                stats[n.frame].total += n.total;
+        }
+        for (int child : n.children)
+            visit(child);
+        if (n.frame >= 0)
+            --onPath[n.frame];
+    };
+    visit(0);
+
+    std::sort(stats.begin(), stats.end(), [](const FunctionStats& a, const FunctionStats& b) { return a.self > b.self; });
+    stats.resize(std::min<size_t>(stats.size(), std::max(count, 0)));
+    return stats;
+}
+
+bool LuaProfiler::exportCollapsed(const char* path) const
+{
+    FILE* file = fopen(path, "w");
+    if (!file)
+        return false;
+
+    std::string stack;
+    std::function<void(int)> visit = [&](int node) {
+        const Node& n = m_nodes[node];
+        const size_t length = stack.size();
+        if (n.frame >= 0) {
+            if (length)
+                stack += ';';
+            stack += m_frameNames[n.frame];
+            if (n.self)
+                fprintf(file, "%s %llu\n", stack.c_str(), (unsigned long long)n.self);
+        }
+        for (int child : n.children)
+            visit(child);
+        stack.resize(length);
+    };
+    visit(0);
+
+    return fclose(file) == 0;
+}
+
+//
+// ImGui view
+//
+
+namespace {
+ImU32 frameColor(int frame)
+{
+    const uint32_t h = (uint32_t)frame * 2654435761u;
+    return IM_COL32(200 + (h & 0x37), 90 + ((h >> 8) & 0x5f), 40 + ((h >> 16) & 0x3f), 255);
+}
+
+void drawFlameNode(const LuaProfiler& profiler, int node, ImVec2 pos, float width, float rowHeight)
+{
+    const LuaProfiler::Node& n = profiler.getNodes()[node];
+    ImDrawList* drawList = ImGui::GetWindowDrawList();
+    const ImVec2 max(pos.x + width, pos.y + rowHeight - 1);
+
+    if (n.frame >= 0) {
+        const std::string& name = profiler.getFrameName(n.frame);
+        drawList->AddRectFilled(pos, max, frameColor(n.frame));
+        if (width > 30) {
+            drawList->PushClipRect(pos, max, true);
+            drawList->AddText(ImVec2(pos.x + 3, pos.y + 1), IM_COL32(0, 0, 0, 255), name.c_str());
+            drawList->PopClipRect();
+        }
+        if (ImGui::IsMouseHoveringRect(pos, max))
+            ImGui::SetTooltip("%s\n%llu samples (%.1f%%), self %llu", name.c_str(), (unsigned long long)n.total,
+                100.0 * n.total / std::max<uint64_t>(profiler.getNumSamples(), 1), (unsigned long long)n.self);
+        pos.y += rowHeight;
+    }
+
+    for (int child : n.children) {
+        const float childWidth = width * profiler.getNodes()[child].total / std::max<uint64_t>(n.total, 1);
+        if (childWidth >= 1.0f)
+            drawFlameNode(profiler, child, pos, childWidth, rowHeight);
+        pos.x += childWidth;
+    }
+}
+
+int treeDepth(const LuaProfiler& profiler, int node)
+{
+    int depth = 0;
+    for (int child : profiler.getNodes()[node].children)
+        depth = std::max(depth, treeDepth(profiler, child));
+    return depth + 1;
+}
+} // namespace
+
+void drawLuaProfilerWindow(LuaProfiler& profiler, const char* exportPath)
+{
+    static int mode = 0;
+    static int period[2] = { 1000, 500 }; // instructions, microseconds
+    static char status[256] = "";
+
+    ImGui::Begin("Lua sampling profiler");
+    if (ImGui::Button(profiler.isRunning() ? "Stop" : "Start")) {
+        if (profiler.isRunning())
+            profiler.stop();
+        else
+            profiler.start(mode == 0 ? LuaProfiler::Mode::Instructions : LuaProfiler::Mode::Timer, period[mode]);
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("Clear"))
+        profiler.clear();
+    ImGui::SameLine();
+    if (ImGui::Button("Export"))
+        snprintf(status, sizeof(status), profiler.exportCollapsed(exportPath) ? "wrote %s" : "cannot write %s", exportPath);
+
+    ImGui::BeginDisabled(profiler.isRunning());
+    ImGui::RadioButton("instructions", &mode, 0);
+    ImGui::SameLine();
+    ImGui::RadioButton("timer (us)", &mode, 1);
+    ImGui::SameLine();
+    ImGui::SetNextItemWidth(150);
+    ImGui::InputInt("period", &period[mode]);
+    ImGui::EndDisabled();
+
+    ImGui::Text("%llu samples %s", (unsigned long long)profiler.getNumSamples(), status);
+
+    const float rowHeight = ImGui::GetTextLineHeight() + 2;
+    const ImVec2 origin = ImGui::GetCursorScreenPos();
+    const float width = ImGui::GetContentRegionAvail().x;
+    const int depth = treeDepth(profiler, 0) - 1;
+    if (profiler.getNumSamples())
+        drawFlameNode(profiler, 0, origin, width, rowHeight);
+    ImGui::Dummy(ImVec2(width, depth * rowHeight));
+
+    if (ImGui::BeginTable("top", 3, ImGuiTableFlags_RowBg | ImGuiTableFlags_SizingStretchProp)) {
+        ImGui::TableSetupColumn("function");
+        ImGui::TableSetupColumn("self %");
+        ImGui::TableSetupColumn("total %");
+        ImGui::TableHeadersRow();
+
+        const double scale = 100.0 / std::max<uint64_t>(profiler.getNumSamples(), 1);
+        for (const LuaProfiler::FunctionStats& f : profiler.getTopFunctions(20)) {
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            ImGui::TextUnformatted(profiler.getFrameName(f.frame).c_str());
+            ImGui::TableNextColumn();
+            ImGui::Text("%.1f", f.self * scale);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.1f", f.total * scale);
+        }
+        ImGui::EndTable();
+    }
+    ImGui::End();
+}
@@ -0,0 +1,90 @@
+#ifndef LUA_PROFILER_H
+#define LUA_PROFILER_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+struct lua_State;
+struct lua_Debug;
+
+// Sampling profiler on a count hook. Instructions mode takes a sample every
+// `period` VM instructions; Timer mode checks a flag every few hundred
+// instructions that a timer thread raises every `period` microseconds, so
+// samples are weighted by wall time. Samples are merged into a call tree
+// keyed by function definition site. The hook is shared through lua_hooks.h.
+class LuaProfiler {
+public:
+    enum class Mode {
+        Instructions,
+        Timer,
+    };
+
+    struct Node {
+        int frame; // index into frame names, -1 for the root
+        int parent;
+        uint64_t total = 0; // samples in this node and below
+        uint64_t self = 0;
+        std::vector<int> children;
+
+        Node(int f, int p)
+            : frame(f)
+            , parent(p)
+        {
+        }
+    };
+
+    struct FunctionStats {
+        int frame;
+        uint64_t self;
+        uint64_t total; // recursion counted once per sample
+    };
+
+    explicit LuaProfiler(lua_State* L);
+    ~LuaProfiler() { stop(); } // before lua_close
+
+    LuaProfiler(const LuaProfiler&) = delete;
+    LuaProfiler& operator=(const LuaProfiler&) = delete;
+
+    void start(Mode mode, int period);
+    void stop();
+    void clear();
+    bool isRunning() const { return m_running; }
+
+    uint64_t getNumSamples() const { return m_nodes[0].total; }
+    const std::vector<Node>& getNodes() const { return m_nodes; } // node 0 is the root
+    const std::string& getFrameName(int frame) const { return m_frameNames[frame]; }
+
+    // by self samples, descending
+    std::vector<FunctionStats> getTopFunctions(int count) const;
+
+    // one "outer;...;inner samples" line per stack, for flamegraph.pl and friends
+    bool exportCollapsed(const char* path) const;
+
+private:
+    static bool hook(lua_State* L, void* userdata);
+    void sample(lua_State* L);
+    int internFrame(lua_State* L, lua_Debug& ar);
+    static std::string frameName(lua_State* L, lua_Debug& ar);
+    int childOf(int node, int frame);
+
+    lua_State* const L;
+    bool m_running = false;
+    Mode m_mode = Mode::Instructions;
+
+    std::vector<Node> m_nodes;
+    std::vector<std::string> m_frameNames;
+    std::unordered_map<uint64_t, int> m_frameIds; // hashed definition site -> frame
+
+    std::thread m_timer;
+    std::atomic<bool> m_sampleRequested { false };
+    std::atomic<bool> m_timerQuit { false };
+};
+
+// ImGui window: flame graph (callers on top), top-N table, start/stop/export controls
+void drawLuaProfilerWindow(LuaProfiler& profiler, const char* exportPath);
+
+#endif // LUA_PROFILER_H
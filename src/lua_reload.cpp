@@ -0,0 +1,263 @@
+#include "lua_reload.h"
+
+#include "lua_cache.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <utility>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+extern "C" {
+#include <lauxlib.h>
+#include <lua.h>
+}
+
+namespace fs = std::filesystem;
+
+namespace {
+constexpr auto pollingInterval = std::chrono::milliseconds(250);
+
+std::string canonicalPath(const std::string& path)
+{
+    std::error_code error;
+    const fs::path canonical = fs::weakly_canonical(path, error);
+    return error ? path : canonical.string();
+}
+
+int64_t writeTime(const std::string& path)
+{
+    std::error_code error;
+    const auto time = fs::last_write_time(path, error);
+    return error ? 0 : (int64_t)time.time_since_epoch().count();
+}
+
+// name, canonical file of every package.loaded entry found on package.path
+std::vector<std::pair<std::string, std::string>> fileModules(lua_State* L)
+{
+    std::vector<std::pair<std::string, std::string>> modules;
+    lua_getglobal(L, "package");
+    if (!lua_istable(L, -1)) {
+        lua_pop(L, 1);
+        return modules;
+    }
+    lua_getfield(L, -1, "loaded");
+    lua_getfield(L, -2, "searchpath");
+    lua_getfield(L, -3, "path");
+    if (!lua_istable(L, -3) || !lua_isfunction(L, -2) || !lua_isstring(L, -1)) {
+        lua_pop(L, 4);
+        return modules;
+    }
+
+    // stack: package loaded searchpath path
+    lua_pushnil(L);
+    while (lua_next(L, -4)) {
+        lua_pop(L, 1);
+        if (lua_type(L, -1) != LUA_TSTRING)
+            continue;
+        lua_pushvalue(L, -3);
+        lua_pushvalue(L, -2);
+        lua_pushvalue(L, -4);
+        lua_call(L, 2, 1);
+        if (const char* file = lua_tostring(L, -1))
+            modules.emplace_back(lua_tostring(L, -2), canonicalPath(file));
+        lua_pop(L, 1);
+    }
+    lua_pop(L, 4);
+    return modules;
+}
+
+// adds the keys of the table at from missing in the table at to
+void mergeMissing(lua_State* L, int to, int from)
+{
+    lua_pushnil(L);
+    while (lua_next(L, from)) {
+        lua_pushvalue(L, -2);
+        if (lua_rawget(L, to) == LUA_TNIL) {
+            lua_pop(L, 1);
+            lua_pushvalue(L, -2);
+            lua_insert(L, -2);
+            lua_rawset(L, to);
+        } else {
+            lua_pop(L, 2);
+        }
+    }
+}
+} // namespace
+
+//
+// LuaFileWatcher
+//
+
+LuaFileWatcher::LuaFileWatcher()
+{
+#ifdef __linux__
+    m_inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#endif
+}
+
+LuaFileWatcher::~LuaFileWatcher()
+{
+#ifdef __linux__
+    if (m_inotify >= 0)
+        close(m_inotify);
+#endif
+}
+
+std::string LuaFileWatcher::watch(const std::string& path)
+{
+    const std::string file = canonicalPath(path);
+    if (m_files.count(file))
+        return file;
+
+    File& watched = m_files[file];
+    hashLuaFile(file.c_str(), watched.hash);
+    watched.writeTime = writeTime(file);
+
+#ifdef __linux__
+    if (m_inotify < 0)
+        return file;
+
+    // the directory, not the file: a save by rename replaces the file's inode
+    const std::string dir = fs::path(file).parent_path().string();
+    const int wd = inotify_add_watch(m_inotify, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+    if (wd >= 0) {
+        m_dirs[wd] = dir;
+    } else {
+        printf("inotify cannot watch %s, polling instead\n", dir.c_str());
+        close(m_inotify);
+        m_inotify = -1;
+    }
+#endif
+    return file;
+}
+
+void LuaFileWatcher::readEvents()
+{
+#ifdef __linux__
+    alignas(inotify_event) char buffer[4096];
+    for (;;) {
+        const ssize_t size = read(m_inotify, buffer, sizeof(buffer));
+        if (size <= 0)
+            break; // EAGAIN: no more events
+
+        for (const char* p = buffer; p < buffer + size;) {
+            const auto* event = (const inotify_event*)p;
+            p += sizeof(inotify_event) + event->len;
+
+            auto dir = m_dirs.find(event->wd);
+            if (dir == m_dirs.end() || !event->len)
+                continue;
+            auto file = m_files.find((fs::path(dir->second) / event->name).string());
+            if (file != m_files.end())
+                file->second.dirty = true;
+        }
+    }
+#endif
+}
+
+std::vector<std::string> LuaFileWatcher::poll()
+{
+    if (usingInotify()) {
+        readEvents();
+    } else {
+        const auto now = std::chrono::steady_clock::now();
+        if (now - m_lastPoll < pollingInterval)
+            return {};
+        m_lastPoll = now;
+
+        for (auto& [path, file] : m_files) {
+            const int64_t time = writeTime(path);
+            if (time != file.writeTime) {
+                file.writeTime = time;
+                file.dirty = true;
+            }
+        }
+    }
+
+    std::vector<std::string> changed;
+    for (auto& [path, file] : m_files) {
+        if (!file.dirty)
+            continue;
+        file.dirty = false;
+
+        uint64_t hash;
+        if (hashLuaFile(path.c_str(), hash) && hash != file.hash) {
+            file.hash = hash;
+            changed.push_back(path);
+        }
+    }
+    return changed;
+}
+
+//
+// reload
+//
+
+std::vector<std::string> getLuaModuleFiles(lua_State* L)
+{
+    std::vector<std::string> files;
+    for (auto& module : fileModules(L))
+        files.push_back(std::move(module.second));
+    return files;
+}
+
+int reloadLuaScript(lua_State* L, const char* script, const std::vector<std::string>& changedFiles,
+    const std::vector<std::string>& preservedGlobals)
+{
+    const int top = lua_gettop(L);
+    const auto modules = fileModules(L);
+
+    lua_getglobal(L, "package");
+    if (lua_istable(L, -1))
+        lua_getfield(L, -1, "loaded");
+    else
+        lua_newtable(L);
+    lua_remove(L, -2);
+    const int loaded = top + 1;
+
+    // dropped modules, name -> old value
+    lua_newtable(L);
+    const int oldModules = top + 2;
+    for (const auto& [name, file] : modules) {
+        if (std::find(changedFiles.begin(), changedFiles.end(), file) == changedFiles.end())
+            continue;
+        lua_getfield(L, loaded, name.c_str());
+        lua_setfield(L, oldModules, name.c_str());
+        lua_pushnil(L);
+        lua_setfield(L, loaded, name.c_str());
+    }
+
+    lua_createtable(L, 0, (int)preservedGlobals.size());
+    const int oldGlobals = top + 3;
+    for (const std::string& name : preservedGlobals) {
+        lua_getglobal(L, name.c_str());
+        lua_setfield(L, oldGlobals, name.c_str());
+    }
+
+    const int status = doLuaFileCached(L, script);
+    if (status != LUA_OK) {
+        printf("Lua reload error: %s\n", lua_tostring(L, -1));
+        mergeMissing(L, loaded, oldModules); // the modules it did not get to require again
+    }
+    lua_settop(L, oldGlobals);
+
+    for (const std::string& name : preservedGlobals) {
+        if (lua_getfield(L, oldGlobals, name.c_str()) == LUA_TNIL) {
+            lua_pop(L, 1); // nothing to keep, the new value stays
+            continue;
+        }
+        lua_getglobal(L, name.c_str());
+        if (lua_istable(L, -2) && lua_istable(L, -1))
+            mergeMissing(L, lua_absindex(L, -2), lua_absindex(L, -1));
+        lua_pop(L, 1);
+        lua_setglobal(L, name.c_str());
+    }
+
+    lua_settop(L, top);
+    return status;
+}
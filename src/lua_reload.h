@@ -0,0 +1,60 @@
+#ifndef LUA_RELOAD_H
+#define LUA_RELOAD_H
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct lua_State;
+
+// Watches script files for content changes. On Linux inotify watches the
+// parent directories, so editors that save through a rename are seen too;
+// elsewhere, or if inotify is unavailable, modification times are polled.
+// A file only counts as changed when its content hash differs, so touching
+// or re-saving it unchanged does nothing. Paths are made canonical.
+class LuaFileWatcher {
+public:
+    LuaFileWatcher();
+    ~LuaFileWatcher();
+
+    LuaFileWatcher(const LuaFileWatcher&) = delete;
+    LuaFileWatcher& operator=(const LuaFileWatcher&) = delete;
+
+    // returns the canonical path, a no-op for a path already watched
+    std::string watch(const std::string& path);
+
+    // canonical paths of the files whose content changed since the last poll, never blocks
+    std::vector<std::string> poll();
+
+    bool usingInotify() const { return m_inotify >= 0; }
+
+private:
+    struct File {
+        uint64_t hash = 0;
+        int64_t writeTime = 0; // polling fallback
+        bool dirty = false;
+    };
+
+    void readEvents();
+
+    int m_inotify = -1;
+    std::unordered_map<int, std::string> m_dirs; // watch descriptor -> directory
+    std::unordered_map<std::string, File> m_files;
+    std::chrono::steady_clock::time_point m_lastPoll;
+};
+
+// canonical paths of the modules in package.loaded that require() found on package.path
+std::vector<std::string> getLuaModuleFiles(lua_State* L);
+
+// Reruns script in L after the files in changedFiles changed. Modules loaded
+// from those files are dropped from package.loaded, so the script's require
+// recompiles them; the other modules stay loaded and are not rerun. Tables in
+// the preserved globals survive: the new run's table only adds the keys the
+// old one lacks. If the script fails, the dropped modules are put back.
+// Returns the lua_pcall status, the error is printed.
+int reloadLuaScript(lua_State* L, const char* script, const std::vector<std::string>& changedFiles,
+    const std::vector<std::string>& preservedGlobals = {});
+
+#endif // LUA_RELOAD_H
@@ -0,0 +1,332 @@
+#include "lua_scheduler.h"
+
+#include <algorithm>
+#include <cstdio>
+
+extern "C" {
+#include <lauxlib.h>
+#include <lua.h>
+}
+
+namespace {
+// first value yielded by the wait functions, anything else is a bare yield
+char waitMarker;
+
+enum YieldKind {
+    YieldTime,
+    YieldSignal,
+    YieldPredicate,
+};
+
+// yields marker, kind, args...
+int yieldWait(lua_State* L, YieldKind kind)
+{
+    lua_pushlightuserdata(L, &waitMarker);
+    lua_pushinteger(L, kind);
+    lua_rotate(L, 1, 2);
+    return lua_yield(L, lua_gettop(L));
+}
+
+// wait(seconds)
+int l_wait(lua_State* L)
+{
+    luaL_checknumber(L, 1);
+    lua_settop(L, 1);
+    return yieldWait(L, YieldTime);
+}
+
+// waitSignal(name)
+int l_waitSignal(lua_State* L)
+{
+    luaL_checkstring(L, 1);
+    lua_settop(L, 1);
+    return yieldWait(L, YieldSignal);
+}
+
+// waitUntil(predicate [, interval]), returns at once if the predicate holds
+int l_waitUntil(lua_State* L)
+{
+    luaL_checktype(L, 1, LUA_TFUNCTION);
+    const lua_Number interval = luaL_optnumber(L, 2, 0.0);
+    lua_settop(L, 1);
+    lua_pushnumber(L, interval);
+
+    lua_pushvalue(L, 1);
+    lua_call(L, 0, 1);
+    if (lua_toboolean(L, -1))
+        return 0;
+    lua_pop(L, 1);
+    return yieldWait(L, YieldPredicate);
+}
+} // namespace
+
+LuaBotScheduler::LuaBotScheduler(lua_State* L)
+    : L(L)
+{
+    lua_pushlightuserdata(L, this);
+    lua_pushcclosure(L, l_spawnBot, 1);
+    lua_setglobal(L, "spawnBot");
+    lua_pushlightuserdata(L, this);
+    lua_pushcclosure(L, l_signal, 1);
+    lua_setglobal(L, "signal");
+    lua_register(L, "wait", l_wait);
+    lua_register(L, "waitSignal", l_waitSignal);
+    lua_register(L, "waitUntil", l_waitUntil);
+}
+
+void LuaBotScheduler::setWatchdog(LuaWatchdog* watchdog, const LuaWatchdog::Budget& budget)
+{
+    m_watchdog = watchdog;
+    m_budget = budget;
+}
+
+int LuaBotScheduler::spawn(lua_State* from, int nargs)
+{
+    lua_State* thread = lua_newthread(from);
+    lua_rotate(from, -(nargs + 2), 1); // thread below the function and its args
+    lua_xmove(from, thread, nargs + 1);
+
+    int index;
+    if (!m_freeBots.empty()) {
+        index = m_freeBots.back();
+        m_freeBots.pop_back();
+    } else {
+        index = (int)m_bots.size();
+        m_bots.emplace_back();
+    }
+
+    Bot& bot = m_bots[index];
+    bot.thread = thread;
+    bot.threadRef = luaL_ref(from, LUA_REGISTRYINDEX);
+    bot.numArgs = nargs;
+    ++m_stats.numBots;
+    m_ready.push_back(setWait(index, Wait::Ready));
+    return index + 1;
+}
+
+LuaBotScheduler::WaitRef LuaBotScheduler::setWait(int index, Wait wait, double pollInterval)
+{
+    auto counter = [this](Wait w, double interval) -> int* {
+        switch (w) {
+        case Wait::Time:
+            return &m_stats.numSleeping;
+        case Wait::Predicate:
+            return interval > 0.0 ? &m_stats.numSleeping : &m_stats.numPolling;
+        case Wait::Signal:
+            return &m_stats.numWaitingSignal;
+        default:
+            return nullptr;
+        }
+    };
+
+    Bot& bot = m_bots[index];
+    if (int* c = counter(bot.wait, bot.pollInterval))
+        --*c;
+    if (int* c = counter(wait, pollInterval))
+        ++*c;
+
+    bot.wait = wait;
+    bot.pollInterval = pollInterval;
+    return { index, ++bot.generation };
+}
+
+bool LuaBotScheduler::isCurrent(const WaitRef& ref) const
+{
+    return m_bots[ref.bot].generation == ref.generation;
+}
+
+int LuaBotScheduler::signal(const std::string& name)
+{
+    auto it = m_signalWaiters.find(name);
+    if (it == m_signalWaiters.end())
+        return 0;
+
+    int numWoken = 0;
+    for (const WaitRef& ref : it->second) {
+        if (!isCurrent(ref))
+            continue;
+        m_ready.push_back(setWait(ref.bot, Wait::Ready));
+        ++numWoken;
+    }
+    m_signalWaiters.erase(it);
+    return numWoken;
+}
+
+void LuaBotScheduler::update(double now)
+{
+    m_now = now;
+    m_stats.resumedLastUpdate = 0;
+    m_due.clear();
+
+    for (const WaitRef& ref : m_ready)
+        if (isCurrent(ref))
+            m_due.push_back(ref.bot);
+    m_ready.clear();
+
+    while (!m_sleeping.empty() && m_sleeping.top().wakeTime <= now) {
+        const WaitRef ref = m_sleeping.top().ref;
+        m_sleeping.pop();
+        if (!isCurrent(ref))
+            continue;
+
+        // predicates may spawn bots, no Bot& across the call
+        if (m_bots[ref.bot].wait != Wait::Predicate || checkPredicate(ref.bot))
+            m_due.push_back(ref.bot);
+        else if (m_bots[ref.bot].wait == Wait::Predicate) // still false, poll again later
+            m_sleeping.push({ now + m_bots[ref.bot].pollInterval, ref });
+    }
+
+    // polled predicates, compacted in place
+    size_t numPolling = 0;
+    for (size_t i = 0; i < m_polling.size(); ++i) {
+        const WaitRef ref = m_polling[i];
+        if (!isCurrent(ref))
+            continue;
+        if (checkPredicate(ref.bot))
+            m_due.push_back(ref.bot);
+        else if (m_bots[ref.bot].wait == Wait::Predicate)
+            m_polling[numPolling++] = ref;
+    }
+    m_polling.resize(numPolling);
+
+    for (int index : m_due) {
+        Bot& bot = m_bots[index];
+        if (bot.predicateRef) {
+            luaL_unref(L, LUA_REGISTRYINDEX, bot.predicateRef);
+            bot.predicateRef = 0;
+        }
+        resume(index);
+    }
+}
+
+void LuaBotScheduler::resume(int index)
+{
+    lua_State* thread = m_bots[index].thread;
+    const int numArgs = m_bots[index].numArgs;
+    m_bots[index].numArgs = 0;
+    ++m_stats.resumedLastUpdate;
+
+    // the bot may spawn others: m_bots can grow, re-fetch after the resume
+    int numResults = 0;
+    int status;
+    if (m_watchdog) {
+        LuaWatchdog::Guard guard(*m_watchdog, "bots", m_budget, thread);
+        status = lua_resume(thread, L, numArgs, &numResults);
+    } else {
+        status = lua_resume(thread, L, numArgs, &numResults);
+    }
+    if (status == LUA_OK) {
+        kill(index);
+        return;
+    }
+    if (status != LUA_YIELD) {
+        printf("Lua bot %d error: %s\n", index + 1, lua_tostring(thread, -1));
+        kill(index);
+        return;
+    }
+
+    const int base = lua_gettop(thread) - numResults + 1;
+    if (numResults < 3 || lua_touserdata(thread, base) != &waitMarker) {
+        m_ready.push_back(setWait(index, Wait::Ready)); // bare yield
+        lua_pop(thread, numResults);
+        return;
+    }
+
+    switch ((YieldKind)lua_tointeger(thread, base + 1)) {
+    case YieldTime:
+        m_sleeping.push({ m_now + lua_tonumber(thread, base + 2), setWait(index, Wait::Time) });
+        break;
+
+    case YieldSignal: {
+        // drop waiters that moved on (killed bots) before the list would grow,
+        // so a signal that is never sent does not keep them forever
+        std::vector<WaitRef>& waiters = m_signalWaiters[lua_tostring(thread, base + 2)];
+        if (waiters.size() == waiters.capacity())
+            waiters.erase(std::remove_if(waiters.begin(), waiters.end(), [this](const WaitRef& ref) { return !isCurrent(ref); }),
+                waiters.end());
+        waiters.push_back(setWait(index, Wait::Signal));
+        break;
+    }
+
+    case YieldPredicate: {
+        const double interval = lua_tonumber(thread, base + 3);
+        lua_pushvalue(thread, base + 2);
+        lua_xmove(thread, L, 1);
+        m_bots[index].predicateRef = luaL_ref(L, LUA_REGISTRYINDEX);
+
+        const WaitRef ref = setWait(index, Wait::Predicate, interval);
+        if (interval > 0.0)
+            m_sleeping.push({ m_now + interval, ref });
+        else
+            m_polling.push_back(ref);
+        break;
+    }
+    }
+    lua_pop(thread, numResults);
+}
+
+bool LuaBotScheduler::checkPredicate(int index)
+{
+    lua_rawgeti(L, LUA_REGISTRYINDEX, m_bots[index].predicateRef);
+    int status;
+    if (m_watchdog) {
+        LuaWatchdog::Guard guard(*m_watchdog, "bots", m_budget);
+        status = lua_pcall(L, 0, 1, 0);
+    } else {
+        status = lua_pcall(L, 0, 1, 0);
+    }
+    if (status != LUA_OK) {
+        printf("Lua bot %d predicate error: %s\n", index + 1, lua_tostring(L, -1));
+        lua_pop(L, 1);
+        kill(index);
+        return false;
+    }
+
+    const bool result = lua_toboolean(L, -1);
+    lua_pop(L, 1);
+    return result;
+}
+
+void LuaBotScheduler::kill(int index)
+{
+    Bot& bot = m_bots[index];
+    luaL_unref(L, LUA_REGISTRYINDEX, bot.threadRef);
+    if (bot.predicateRef)
+        luaL_unref(L, LUA_REGISTRYINDEX, bot.predicateRef);
+    setWait(index, Wait::Dead);
+    bot.thread = nullptr;
+    bot.threadRef = 0;
+    bot.predicateRef = 0;
+    bot.numArgs = 0;
+    m_freeBots.push_back(index);
+    --m_stats.numBots;
+}
+
+void LuaBotScheduler::reset()
+{
+    for (int i = 0; i < (int)m_bots.size(); ++i)
+        if (m_bots[i].wait != Wait::Dead)
+            kill(i);
+
+    m_ready.clear();
+    m_polling.clear();
+    m_sleeping = {};
+    m_signalWaiters.clear();
+}
+
+// spawnBot(f, ...) -> id
+int LuaBotScheduler::l_spawnBot(lua_State* L)
+{
+    auto* self = (LuaBotScheduler*)lua_touserdata(L, lua_upvalueindex(1));
+    luaL_checktype(L, 1, LUA_TFUNCTION);
+    lua_pushinteger(L, self->spawn(L, lua_gettop(L) - 1));
+    return 1;
+}
+
+// signal(name) -> number of bots woken
+int LuaBotScheduler::l_signal(lua_State* L)
+{
+    auto* self = (LuaBotScheduler*)lua_touserdata(L, lua_upvalueindex(1));
+    lua_pushinteger(L, self->signal(luaL_checkstring(L, 1)));
+    return 1;
+}
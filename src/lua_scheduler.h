@@ -0,0 +1,115 @@
+#ifndef LUA_SCHEDULER_H
+#define LUA_SCHEDULER_H
+
+#include "lua_watchdog.h"
+
+#include <cstdint>
+#include <queue>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+struct lua_State;
+
+// Runs bots as Lua coroutines on one lua_State. A bot is a function that
+// yields through the wait functions below; update() resumes only the bots
+// whose condition is met:
+//     wait(seconds)                     wake-time min-heap, free while asleep
+//     waitSignal(name)                  woken by signal(name), free while asleep
+//     waitUntil(predicate [, interval]) predicate polled every update, or
+//                                       every interval seconds via the heap
+// A bare coroutine.yield() waits for the next update.
+// With a watchdog, a resume that runs over budget yields the same way, and a
+// predicate over budget fails; usage is reported under "bots".
+// Scripts get spawnBot(f, ...) -> id and signal(name) -> number woken.
+class LuaBotScheduler {
+public:
+    struct Stats {
+        int numBots = 0;
+        int numSleeping = 0; // wait() and waitUntil with an interval
+        int numPolling = 0; // waitUntil without an interval
+        int numWaitingSignal = 0;
+        int resumedLastUpdate = 0;
+    };
+
+    // registers spawnBot, signal, wait, waitSignal and waitUntil in L
+    explicit LuaBotScheduler(lua_State* L);
+    ~LuaBotScheduler() { reset(); }
+
+    LuaBotScheduler(const LuaBotScheduler&) = delete;
+    LuaBotScheduler& operator=(const LuaBotScheduler&) = delete;
+
+    // pops the function and nargs arguments from L, returns the bot id
+    int spawn(int nargs) { return spawn(L, nargs); }
+
+    // budget per resume and per predicate check, nullptr for none
+    void setWatchdog(LuaWatchdog* watchdog, const LuaWatchdog::Budget& budget);
+
+    // wakes the bots waiting on name at the next update, returns their number
+    int signal(const std::string& name);
+
+    // now: seconds on the caller's clock, must not go backwards
+    void update(double now);
+
+    // drops all bots, call before lua_close
+    void reset();
+
+    const Stats& getStats() const { return m_stats; }
+
+private:
+    enum class Wait {
+        Ready,
+        Time,
+        Predicate,
+        Signal,
+        Dead,
+    };
+
+    struct Bot {
+        lua_State* thread = nullptr;
+        int threadRef = 0;
+        int predicateRef = 0;
+        double pollInterval = 0.0;
+        int numArgs = 0; // arguments waiting on the thread stack for the first resume
+        uint32_t generation = 0; // invalidates heap entries of earlier waits
+        Wait wait = Wait::Dead;
+    };
+
+    // a bot in a given wait; stale once the bot moves on (generation changes)
+    struct WaitRef {
+        int bot;
+        uint32_t generation;
+    };
+
+    struct HeapEntry {
+        double wakeTime;
+        WaitRef ref;
+        bool operator>(const HeapEntry& other) const { return wakeTime > other.wakeTime; }
+    };
+
+    int spawn(lua_State* from, int nargs);
+    WaitRef setWait(int bot, Wait wait, double pollInterval = 0.0);
+    bool isCurrent(const WaitRef& ref) const;
+    void resume(int bot);
+    bool checkPredicate(int bot); // kills the bot if the predicate errors
+    void kill(int bot);
+
+    static int l_spawnBot(lua_State* L);
+    static int l_signal(lua_State* L);
+
+    lua_State* const L;
+    std::vector<Bot> m_bots;
+    std::vector<int> m_freeBots;
+    std::vector<WaitRef> m_ready; // resumed at the next update
+    std::vector<WaitRef> m_polling;
+    std::priority_queue<HeapEntry, std::vector<HeapEntry>, std::greater<HeapEntry>> m_sleeping;
+    std::unordered_map<std::string, std::vector<WaitRef>> m_signalWaiters;
+    std::vector<int> m_due; // scratch for update()
+    double m_now = 0.0;
+    Stats m_stats;
+    LuaWatchdog* m_watchdog = nullptr;
+    LuaWatchdog::Budget m_budget;
+};
+
+#endif // LUA_SCHEDULER_H
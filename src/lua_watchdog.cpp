@@ -0,0 +1,85 @@
+#include "lua_watchdog.h"
+
+#include "lua_hooks.h"
+
+#include <algorithm>
+#include <cstdio>
+
+extern "C" {
+#include <lauxlib.h>
+#include <lua.h>
+}
+
+LuaWatchdog::Guard::Guard(LuaWatchdog& watchdog, const char* script, const Budget& budget, lua_State* thread)
+    : m_watchdog(watchdog)
+    , m_script(script)
+    , m_budget(budget)
+    , m_thread(thread)
+    , m_start(std::chrono::steady_clock::now())
+{
+    if (thread)
+        installLuaHooks(thread);
+    watchdog.m_guards.push_back(this);
+}
+
+LuaWatchdog::Guard::~Guard()
+{
+    m_watchdog.m_guards.pop_back();
+
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - m_start).count();
+    ScriptStats& stats = m_watchdog.m_scripts[m_script];
+    ++stats.calls;
+    stats.overBudget += m_overBudget;
+    stats.instructions += m_instructions;
+    stats.seconds += seconds;
+    stats.lastUsage = usage(seconds);
+    stats.peakUsage = std::max(stats.peakUsage, stats.lastUsage);
+}
+
+float LuaWatchdog::Guard::usage(double seconds) const
+{
+    float result = 0.0f;
+    if (m_budget.instructions)
+        result = std::max(result, float(m_instructions) / m_budget.instructions);
+    if (m_budget.seconds > 0.0)
+        result = std::max(result, float(seconds / m_budget.seconds));
+    return result;
+}
+
+LuaWatchdog::LuaWatchdog(lua_State* L, int checkPeriod)
+    : L(L)
+    , m_checkPeriod(std::max(checkPeriod, 1))
+{
+    addLuaHook(L, hook, this, m_checkPeriod);
+}
+
+void LuaWatchdog::stop()
+{
+    if (!m_running)
+        return;
+    removeLuaHook(L, hook, this);
+    m_running = false;
+}
+
+// no objects with destructors alive at luaL_error
+bool LuaWatchdog::hook(lua_State* L, void* userdata)
+{
+    auto* self = (LuaWatchdog*)userdata;
+    if (self->m_guards.empty())
+        return false;
+
+    Guard& guard = *self->m_guards.back();
+    guard.m_instructions += self->m_checkPeriod;
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - guard.m_start).count();
+    if (guard.usage(seconds) <= 1.0f)
+        return false;
+
+    guard.m_overBudget = true;
+    if (guard.m_thread == L && lua_isyieldable(L))
+        return true;
+    char message[128]; // lua_pushfstring knows no precision or long long
+    snprintf(message, sizeof(message), "%s over budget (%llu instructions, %.2f ms)", guard.m_script,
+        (unsigned long long)guard.m_instructions, seconds * 1000.0);
+    luaL_error(L, "%s", message);
+    return false;
+}
@@ -0,0 +1,80 @@
+#ifndef LUA_WATCHDOG_H
+#define LUA_WATCHDOG_H
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct lua_State;
+
+// Bounds the Lua code run while a Guard lives, with an instruction and a
+// time budget checked from a count hook (lua_hooks.h). Over budget, code
+// resumed under a guard for its own coroutine yields (the next resume gets a
+// fresh budget); anything else gets an error, "<script> over budget ...",
+// raised again every check until it leaves the guard. Instructions are
+// counted in steps of checkPeriod. Usage is kept per script name.
+class LuaWatchdog {
+public:
+    struct Budget {
+        uint64_t instructions = 0; // 0: unlimited
+        double seconds = 0.0; // 0: unlimited
+    };
+
+    struct ScriptStats {
+        uint64_t calls = 0;
+        uint64_t overBudget = 0;
+        uint64_t instructions = 0;
+        double seconds = 0.0;
+        float lastUsage = 0.0f; // fraction of the budget used by the last call
+        float peakUsage = 0.0f;
+    };
+
+    class Guard {
+    public:
+        // thread: the coroutine about to be resumed, which yields instead of failing
+        Guard(LuaWatchdog& watchdog, const char* script, const Budget& budget, lua_State* thread = nullptr);
+        ~Guard();
+
+        Guard(const Guard&) = delete;
+        Guard& operator=(const Guard&) = delete;
+
+        bool isOverBudget() const { return m_overBudget; }
+
+    private:
+        friend class LuaWatchdog;
+
+        float usage(double seconds) const;
+
+        LuaWatchdog& m_watchdog;
+        const char* const m_script;
+        const Budget m_budget;
+        lua_State* const m_thread;
+        const std::chrono::steady_clock::time_point m_start;
+        uint64_t m_instructions = 0;
+        bool m_overBudget = false;
+    };
+
+    explicit LuaWatchdog(lua_State* L, int checkPeriod = 1000);
+    ~LuaWatchdog() { stop(); }
+
+    LuaWatchdog(const LuaWatchdog&) = delete;
+    LuaWatchdog& operator=(const LuaWatchdog&) = delete;
+
+    // removes the hook, budgets are no longer enforced; call before lua_close
+    void stop();
+
+    const std::unordered_map<std::string, ScriptStats>& getScripts() const { return m_scripts; }
+
+private:
+    static bool hook(lua_State* L, void* userdata);
+
+    lua_State* const L;
+    const int m_checkPeriod;
+    bool m_running = true;
+    std::vector<Guard*> m_guards; // innermost last
+    std::unordered_map<std::string, ScriptStats> m_scripts;
+};
+
+#endif // LUA_WATCHDOG_H
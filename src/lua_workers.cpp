@@ -0,0 +1,125 @@
+#include "lua_workers.h"
+
+#include "lua_alloc.h"
+#include "lua_functions.h"
+#include "lua_reload.h"
+#include "lua_watchdog.h"
+
+namespace {
+// per updateBot call, far above what a healthy bot runs; instructions rather
+// than time so a bot's result never depends on load, sharding or preemption
+constexpr LuaWatchdog::Budget botBudget = { 200000, 0 };
+} // namespace
+
+LuaWorkerPool::LuaWorkerPool(int numWorkers, InitFunction init)
+    : m_numWorkers(std::max(numWorkers, 1))
+{
+    m_numPending = m_numWorkers;
+    for (int i = 0; i < m_numWorkers; ++i)
+        m_threads.emplace_back([this, i, init] { workerMain(i, init); });
+
+    // states are created on their own threads; wait until all scripts are loaded
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_done.wait(lock, [this] { return m_numPending == 0; });
+}
+
+LuaWorkerPool::~LuaWorkerPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_quit = true;
+    }
+    m_wake.notify_all();
+    for (std::thread& thread : m_threads)
+        thread.join();
+}
+
+void LuaWorkerPool::updateBots(const BotInput* in, BotOutput* out, int numBots, double dt)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_in = in;
+    m_out = out;
+    m_numBots = numBots;
+    m_dt = dt;
+    m_numPending = m_numWorkers;
+    ++m_generation;
+    m_wake.notify_all();
+    m_done.wait(lock, [this] { return m_numPending == 0; });
+}
+
+void LuaWorkerPool::reload(const std::string& script, const std::vector<std::string>& changedFiles)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_reloadScript = script;
+    m_reloadFiles = changedFiles;
+    ++m_reloadGeneration;
+}
+
+void LuaWorkerPool::workerMain(int workerIndex, const InitFunction& init)
+{
+    LuaAllocator allocator;
+    lua_State* L = allocator.newState();
+    luaL_openlibs(L);
+    registerMathFunctions(L);
+    if (init)
+        init(L);
+
+    LuaWatchdog watchdog(L);
+    LuaFunction<std::tuple<Float, Float>(int, Float, Float, double)> updateBot(L, "updateBot");
+    if (!updateBot)
+        printf("Lua worker %d: no updateBot function\n", workerIndex);
+
+    uint64_t generation = 0;
+    uint64_t reloadGeneration = 0;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (--m_numPending == 0)
+            m_done.notify_one();
+    }
+
+    for (;;) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_wake.wait(lock, [&] { return m_quit || m_generation != generation; });
+        if (m_quit)
+            break;
+        generation = m_generation;
+        const BotInput* in = m_in;
+        BotOutput* out = m_out;
+        const int numBots = m_numBots;
+        const double dt = m_dt;
+        std::string reloadScript;
+        std::vector<std::string> reloadFiles;
+        if (reloadGeneration != m_reloadGeneration) {
+            reloadGeneration = m_reloadGeneration;
+            reloadScript = m_reloadScript;
+            reloadFiles = m_reloadFiles;
+        }
+        lock.unlock();
+
+        if (!reloadScript.empty()) {
+            reloadLuaScript(L, reloadScript.c_str(), reloadFiles);
+            updateBot.bind(L, "updateBot");
+        }
+
+        // contiguous ranges keep workers off each other's cache lines
+        const int first = int((int64_t)numBots * workerIndex / m_numWorkers);
+        const int last = int((int64_t)numBots * (workerIndex + 1) / m_numWorkers);
+        for (int i = first; i < last; ++i) {
+            LuaWatchdog::Guard guard(watchdog, "updateBot", botBudget);
+            auto result = updateBot(i + 1, in[i].splineKey, in[i].speed, dt);
+            out[i].ok = result.has_value();
+            if (result)
+                std::tie(out[i].splineKey, out[i].speed) = *result;
+            else
+                out[i].splineKey = in[i].splineKey, out[i].speed = in[i].speed;
+        }
+
+        lock.lock();
+        if (--m_numPending == 0)
+            m_done.notify_one();
+    }
+
+    updateBot.reset();
+    watchdog.stop();
+    lua_close(L);
+}
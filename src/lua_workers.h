@@ -0,0 +1,76 @@
+#ifndef LUA_WORKERS_H
+#define LUA_WORKERS_H
+
+#include "cpp_math.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct lua_State;
+
+struct BotInput {
+    Float splineKey;
+    Float speed;
+};
+
+struct BotOutput {
+    Float splineKey;
+    Float speed;
+    bool ok; // false if updateBot failed or ran over its budget, the input is copied through
+};
+
+// One lua_State per thread, each with registerMathFunctions applied and then
+// init(L), which loads the bot scripts. updateBots() calls the global
+//     updateBot(index, splineKey, speed, dt) -> splineKey, speed
+// for every bot; bots are split into contiguous ranges, one per worker.
+// Shared data (spline, tables) is read through C++ bindings. Scripts must not
+// keep per-bot state in Lua globals: a bot's result then depends only on its
+// input, and any worker count gives the same results as a single state.
+class LuaWorkerPool {
+public:
+    using InitFunction = std::function<void(lua_State*)>;
+
+    LuaWorkerPool(int numWorkers, InitFunction init);
+    ~LuaWorkerPool();
+
+    LuaWorkerPool(const LuaWorkerPool&) = delete;
+    LuaWorkerPool& operator=(const LuaWorkerPool&) = delete;
+
+    int getNumWorkers() const { return m_numWorkers; }
+
+    // blocks until every bot has been updated
+    void updateBots(const BotInput* in, BotOutput* out, int numBots, double dt);
+
+    // every worker reruns script before its next updateBots, see reloadLuaScript
+    void reload(const std::string& script, const std::vector<std::string>& changedFiles);
+
+private:
+    void workerMain(int workerIndex, const InitFunction& init);
+
+    const int m_numWorkers;
+    std::vector<std::thread> m_threads;
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_done;
+    uint64_t m_generation = 0;
+    int m_numPending = 0;
+    bool m_quit = false;
+
+    // current job, written under m_mutex before m_generation changes
+    const BotInput* m_in = nullptr;
+    BotOutput* m_out = nullptr;
+    int m_numBots = 0;
+    double m_dt = 0.0;
+
+    // pending reload, picked up with the next job
+    uint64_t m_reloadGeneration = 0;
+    std::string m_reloadScript;
+    std::vector<std::string> m_reloadFiles;
+};
+
+#endif // LUA_WORKERS_H
@@ -1,15 +1,28 @@
 
-// #include "lua_functions.h"
 #include "TextEditor.h"
 #include "imgui.h"
 #include "imgui_impl_glfw.h"
 #include "imgui_impl_opengl3.h"
 #include "imgui_internal.h"
+#include "lua_alloc.h"
+#include "lua_blob.h"
+#include "lua_cache.h"
+#include "lua_functions.h"
+#include "lua_gc.h"
+#include "lua_live.h"
+#include "lua_profiler.h"
+#include "lua_reload.h"
+#include "lua_scheduler.h"
+#include "lua_watchdog.h"
+#include "lua_workers.h"
 #include "opengl_utils.h"
 
 // #define GL_SILENCE_DEPRECATION
 #include <GLFW/glfw3.h>
+#include <algorithm>
+#include <fstream>
 #include <iostream>
+#include <iterator>
 #include <vector>
 
 #if defined(_MSC_VER) && (_MSC_VER >= 1900) && !defined(IMGUI_DISABLE_WIN32_FUNCTIONS)
@@ -52,6 +65,70 @@ void stylizeImGui()
 
 #include <iostream>
 
+void drawLuaProfilerOverlay(const LuaAllocator& allocator, const LuaGcScheduler& gc, const LuaWatchdog& watchdog)
+{
+    const LuaAllocator::Stats& stats = allocator.getStats();
+    const LuaGcScheduler::Stats& gcStats = gc.getStats();
+    const int offset = allocator.getHistoryOffset();
+
+    ImGui::SetNextWindowSize(ImVec2(600, 0), ImGuiCond_FirstUseEver);
+    ImGui::Begin("Lua profiler");
+    ImGui::Text("live %.1f KB, peak %.1f KB", stats.bytesLive / 1024.0f, stats.bytesPeak / 1024.0f);
+    ImGui::Text("allocations %llu, frees %llu", (unsigned long long)stats.allocations, (unsigned long long)stats.frees);
+    ImGui::PlotLines("live KB", allocator.getLiveKbHistory(), LuaAllocator::historySize, offset,
+        nullptr, 0.0f, FLT_MAX, ImVec2(0, 80));
+    ImGui::PlotLines("allocs/frame", allocator.getAllocationsHistory(), LuaAllocator::historySize, offset,
+        nullptr, 0.0f, FLT_MAX, ImVec2(0, 80));
+
+    ImGui::Text("GC %.3f ms, %d steps of %d KB, %.1f KB/frame allocated", gcStats.frameMs, gcStats.frameSteps,
+        gcStats.stepKb, gcStats.allocRateKb);
+    ImGui::Text("GC cycles %llu, emergency collects %llu", (unsigned long long)gcStats.cycles,
+        (unsigned long long)gcStats.emergencyCollects);
+    ImGui::PlotLines("GC ms", gc.getFrameMsHistory(), LuaGcScheduler::historySize, gc.getHistoryOffset(),
+        nullptr, 0.0f, FLT_MAX, ImVec2(0, 80));
+
+    if (ImGui::BeginTable("budgets", 5, ImGuiTableFlags_RowBg | ImGuiTableFlags_SizingStretchProp)) {
+        ImGui::TableSetupColumn("script");
+        ImGui::TableSetupColumn("calls");
+        ImGui::TableSetupColumn("budget %");
+        ImGui::TableSetupColumn("peak %");
+        ImGui::TableSetupColumn("over budget");
+        ImGui::TableHeadersRow();
+        for (const auto& [script, scriptStats] : watchdog.getScripts()) {
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            ImGui::TextUnformatted(script.c_str());
+            ImGui::TableNextColumn();
+            ImGui::Text("%llu", (unsigned long long)scriptStats.calls);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.1f", scriptStats.lastUsage * 100.0f);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.1f", scriptStats.peakUsage * 100.0f);
+            ImGui::TableNextColumn();
+            ImGui::Text("%llu", (unsigned long long)scriptStats.overBudget);
+        }
+        ImGui::EndTable();
+    }
+    ImGui::End();
+}
+
+// the road sampled at even distances, shared read-only by every Lua state
+LuaBlob buildRoadData(int numSamples)
+{
+    std::vector<Float> distances(numSamples), keys(numSamples);
+    std::vector<Vec3> positions(numSamples);
+    for (int i = 0; i < numSamples; ++i) {
+        distances[i] = spline.GetLength() * i / (numSamples - 1);
+        keys[i] = spline.DistanceToKey(distances[i]);
+        positions[i] = spline.GetInterpAtKey(keys[i]).getPos();
+    }
+    return LuaBlob::Builder()
+        .floats("distances", distances.data(), numSamples)
+        .floats("keys", keys.data(), numSamples)
+        .vec3s("positions", positions.data(), numSamples)
+        .build();
+}
+
 void framebuffer_size_callback(GLFWwindow* window, int width, int height) { glv(width, height); }
 
 bool windowOpen = true;
@@ -115,14 +192,124 @@ int main()
 
     initGL();
 
+    const LuaBlob roadData = buildRoadData(1024); // outlives every state below
+
+    LuaAllocator luaAllocator;
+    lua_State* L = luaAllocator.newState();
+    luaL_openlibs(L);
+    registerMathFunctions(L);
+    setLuaBlob(L, "roadData", roadData);
+    installCachedSearcher(L);
+    LuaProfiler luaProfiler(L);
+
+    // a runaway loop in a script costs its budget, not the 16.6 ms frame
+    LuaWatchdog luaWatchdog(L);
+    const LuaWatchdog::Budget loadBudget = { 0, 0.1 };
+    const LuaWatchdog::Budget updateBudget = { 0, 0.004 };
+    const LuaWatchdog::Budget botBudget = { 100000, 0.001 }; // per resume
+
+    LuaBotScheduler botScheduler(L); // before the script, so it can spawnBot
+    botScheduler.setWatchdog(&luaWatchdog, botBudget);
+
+    // the editor starts on test.lua; its text runs on a background state as it is edited
+    TextEditor::LanguageDefinition luaLanguage = TextEditor::LanguageDefinition::Lua();
+    lua_pushglobaltable(L);
+    lua_pushnil(L);
+    while (lua_next(L, -2)) { // host bindings highlight like the standard library
+        if (lua_type(L, -2) == LUA_TSTRING) {
+            TextEditor::Identifier id;
+            id.mDeclaration = "host binding";
+            luaLanguage.mIdentifiers.insert({ lua_tostring(L, -2), id });
+        }
+        lua_pop(L, 1);
+    }
+    lua_pop(L, 1);
+
     TextEditor te;
-    te.SetLanguageDefinition(TextEditor::LanguageDefinition::C());
+    te.SetLanguageDefinition(luaLanguage);
+    {
+        std::ifstream file(filePath);
+        te.SetText(std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()));
+    }
+    LuaLiveRunner liveRunner([&roadData](lua_State* L) { setLuaBlob(L, "roadData", roadData); });
+    LuaLiveRunner::Result liveResult;
+    liveRunner.submit(te.GetText());
+
+    {
+        LuaWatchdog::Guard guard(luaWatchdog, "load", loadBudget);
+        if (doLuaFileCached(L, filePath.c_str()) != LUA_OK) {
+            std::cerr << "Lua error: " << lua_tostring(L, -1) << std::endl;
+            lua_pop(L, 1);
+        }
+    }
+
+    // update(dt) is optional
+    LuaFunction<void(double)> luaUpdate(L, "update");
+    double lastTime = glfwGetTime();
+
+    // bots.lua runs on one state per core, independent of the editor state
+    const std::string botsPath = PROJECT_DIR "/bots.lua";
+    LuaWorkerPool botWorkers((int)std::thread::hardware_concurrency(), [&botsPath, &roadData](lua_State* L) {
+        setLuaBlob(L, "roadData", roadData);
+        if (doLuaFileCached(L, botsPath.c_str()) != LUA_OK)
+            std::cerr << "Lua error: " << lua_tostring(L, -1) << std::endl;
+    });
+    const int numBots = 1000;
+    std::vector<BotInput> botInputs(numBots);
+    std::vector<BotOutput> botOutputs(numBots);
+    for (int i = 0; i < numBots; ++i)
+        botInputs[i] = { Float(i) / numBots * (spline.GetNumSegments() - 1), 0 };
+    double botTickMs = 0.0;
+
+    // edited scripts are reloaded into the running states, "state" keeps its table
+    const std::vector<std::string> preservedGlobals = { "state" };
+    LuaFileWatcher scriptWatcher;
+    const std::string mainScript = scriptWatcher.watch(filePath);
+    const std::string botsScript = scriptWatcher.watch(botsPath);
+    for (const std::string& module : getLuaModuleFiles(L))
+        scriptWatcher.watch(module);
+
+    // GC runs right after the swap, in the slack the next frame is expected to leave
+    LuaGcScheduler luaGc(L);
+    const double framePeriod = 1.0 / (mode->refreshRate > 0 ? mode->refreshRate : 60);
+    const double maxGcBudget = 0.25 * framePeriod;
+    double frameWork = 0.0; // smoothed time from frame start to the swap
 
     while (!glfwWindowShouldClose(window)) {
         glfwPollEvents();
         int display_w, display_h;
         glfwGetFramebufferSize(window, &display_w, &display_h);
 
+        const std::vector<std::string> changedScripts = scriptWatcher.poll();
+        if (!changedScripts.empty()) {
+            auto changedBesides = [&](const std::string& script) {
+                return std::any_of(changedScripts.begin(), changedScripts.end(), [&](const std::string& f) { return f != script; });
+            };
+            if (changedBesides(botsScript)) {
+                LuaWatchdog::Guard guard(luaWatchdog, "load", loadBudget);
+                reloadLuaScript(L, filePath.c_str(), changedScripts, preservedGlobals);
+                luaUpdate.bind(L, "update");
+                for (const std::string& module : getLuaModuleFiles(L))
+                    scriptWatcher.watch(module);
+            }
+            if (changedBesides(mainScript))
+                botWorkers.reload(botsPath, changedScripts); // applied in the next updateBots
+        }
+
+        const double time = glfwGetTime();
+        if (luaUpdate) {
+            LuaWatchdog::Guard guard(luaWatchdog, "update", updateBudget);
+            luaUpdate(time - lastTime);
+        }
+        lastTime = time;
+        botScheduler.update(time);
+
+        const double botStart = glfwGetTime();
+        botWorkers.updateBots(botInputs.data(), botOutputs.data(), numBots, ImGui::GetIO().DeltaTime);
+        for (int i = 0; i < numBots; ++i)
+            botInputs[i] = { botOutputs[i].splineKey, botOutputs[i].speed };
+        botTickMs = (glfwGetTime() - botStart) * 1000.0;
+
         clear();
         draw();
 
@@ -142,19 +329,53 @@ int main()
                 ImGui::Begin("Multicolor text editor", nullptr, flags);
 
                 te.Render("code", ImVec2(-1, -1), true);
+                if (te.IsTextChanged())
+                    liveRunner.submit(te.GetText());
 
                 ImGui::End();
             }
+            if (liveRunner.poll(liveResult))
+                te.SetErrorMarkers(liveResult.errors);
+
+            drawLuaProfilerOverlay(luaAllocator, luaGc, luaWatchdog);
+
+            ImGui::SetNextWindowSize(ImVec2(700, 500), ImGuiCond_FirstUseEver);
+            drawLuaProfilerWindow(luaProfiler, PROJECT_DIR "/lua_profile.collapsed");
+
+            ImGui::Begin("Bots");
+            ImGui::Text("%d bots on %d Lua workers: %.3f ms", numBots, botWorkers.getNumWorkers(), botTickMs);
+            const LuaBotScheduler::Stats& schedulerStats = botScheduler.getStats();
+            ImGui::Text("%d coroutine bots: %d sleeping, %d polling, %d on signals, %d resumed",
+                schedulerStats.numBots, schedulerStats.numSleeping, schedulerStats.numPolling,
+                schedulerStats.numWaitingSignal, schedulerStats.resumedLastUpdate);
+            ImGui::End();
+
+            ImGui::SetNextWindowSize(ImVec2(600, 300), ImGuiCond_FirstUseEver);
+            ImGui::Begin("Editor output");
+            if (liveResult.revision)
+                ImGui::Text("revision %llu %s in %.2f ms", (unsigned long long)liveResult.revision,
+                    liveResult.ok ? "ok" : "failed", liveResult.ms);
+            ImGui::TextUnformatted(liveResult.output.c_str());
+            ImGui::End();
 
             ImGui::Render();
 
             ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
         }
 
+        frameWork += (glfwGetTime() - time - frameWork) * 0.1;
         glfwSwapBuffers(window);
+        luaGc.step(std::clamp(framePeriod - frameWork, 0.0, maxGcBudget));
+        luaAllocator.endFrame(); // the frame's Lua work, bots and GC slice included
         fflush(stdout);
     }
 
+    luaUpdate.reset();
+    botScheduler.reset();
+    luaProfiler.stop();
+    luaWatchdog.stop();
+    lua_close(L);
+
     uninitGL();
 
     ImGui_ImplOpenGL3_Shutdown();
@@ -205,8 +426,9 @@ int main()
         Vec3 a { 1, 2, 3 };
         Vec3 b { 4, 5, 6 };
 
-        float dot = 0, dist = 0;
-        if (callLuaProcessVecs(L, a, b, dot, dist)) {
+        ProcessVecsFunction processVecs(L, "processVecs");
+        if (auto result = processVecs(a, b)) {
+            auto [dot, dist] = *result;
             printf("dot=%.2f dist=%.2f\n", dot, dist);
         }
 
@@ -19,6 +19,16 @@ row = a:binarySearchByCol(1,7)
 
 
 printTable(row)
+
+-- kept across hot reloads, new fields are added to the running table
+state = { time = 0 }
+
+-- called by the host every frame
+function update(dt)
+    state.time = state.time + dt
+    local key = state.time % (roadSplineNumSegments() - 1)
+    local pos, rot = roadSplinePositionAndRotationAtKey(key)
+end
 --print(a:getRow(1))
 
 
@@ -29,6 +39,15 @@ printTable(row)
 
 --print(roadSplineLength())
 
+--spawnBot(function(name)
+--    while true do
+--        waitSignal("green")
+--        print(name, "drives")
+--        wait(2)
+--    end
+--end, "car1")
+--spawnBot(function() while true do wait(5); signal("green") end end)
+
 --function processVecs(a, b)
 --    -- Example: return dot and distance
 --    local dot = a.x * b.x + a.y * b.y + a.z * b.z